@@ -0,0 +1,88 @@
+#!/bin/bash
+#
+# benchmark.sh: Measure xsys35c and xsys35dc on a synthetic project
+#
+# This generates a project with genproject, and runs the given benchmark on it
+# several times. The project depends only on the genproject options, so the
+# numbers can be compared between builds.
+#
+set -e
+
+usage() {
+	echo 'Usage: benchmark.sh [options] <binary_dir> <benchmark> [genproject options]'
+	echo 'Benchmarks:'
+	echo '    compile     Compile the project'
+	echo '    decompile   Decompile the compiled project'
+	echo '    roundtrip   Decompile and compile again, and check the result'
+	echo 'Options:'
+	echo '    -j <n>      Pass -j <n> to xsys35c (default: 1)'
+	echo '    -k          Keep the generated project and print its location'
+	echo '    -r <n>      Run the benchmark <n> times (default: 5)'
+	exit 1
+}
+
+jobs=1
+keep=
+runs=5
+
+while getopts j:kr:h OPT
+do
+	case $OPT in
+		j) jobs="$OPTARG" ;;
+		k) keep=1 ;;
+		r) runs="$OPTARG" ;;
+		*) usage ;;
+	esac
+done
+shift $((OPTIND - 1))
+
+if [ $# -lt 2 ]; then
+	usage
+fi
+
+bindir=$(cd "$1" && pwd)
+bench="$2"
+shift 2
+
+dir=$(mktemp -d)
+if [ -z "$keep" ]; then
+	trap 'rm -rf "$dir"' EXIT
+else
+	echo "project: $dir"
+fi
+
+${bindir}/genproject "$@" "$dir/src"
+cd "$dir"
+
+compile() {
+	${bindir}/xsys35c -j "$jobs" -p src/xsys35c.cfg -o out -a out.ain
+}
+
+decompile() {
+	rm -rf dc
+	${bindir}/xsys35dc -o dc outSA.ALD out.ain > /dev/null
+}
+
+roundtrip() {
+	decompile
+	${bindir}/xsys35c -j "$jobs" -p dc/xsys35c.cfg -o rt -a rt.ain
+	${bindir}/ald compare outSA.ALD rtSA.ALD
+}
+
+case "$bench" in
+	compile) ;;
+	decompile|roundtrip) compile ;;
+	*) usage ;;
+esac
+
+# EPOCHREALTIME needs bash 5.
+times=()
+for ((i = 0; i < runs; i++)); do
+	start=$EPOCHREALTIME
+	$bench
+	end=$EPOCHREALTIME
+	times+=($(( (${end/./} - ${start/./}) / 1000 )))
+done
+
+sorted=($(printf '%s\n' "${times[@]}" | sort -n))
+echo "$bench: min ${sorted[0]} ms, median ${sorted[$((runs / 2))]} ms (${runs} runs: ${times[*]})"
@@ -0,0 +1,54 @@
+/* Copyright (C) 2026 <KichikuouChrome@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+*/
+
+// The contents of System39.ain (except the first 8 bytes) are obfuscated by
+// rotating each byte right by 2 bits.
+
+#include "common.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Rotates each byte right by `right` bits.
+static void rotate_bytes(uint8_t *dst, const uint8_t *src, size_t len, int right) {
+	size_t i = 0;
+#ifdef __SSE2__
+	// SSE2 has no 8-bit shifts, so the bytes are shifted as 16-bit lanes and
+	// the bits that crossed a byte boundary are masked off.
+	const __m128i rcount = _mm_cvtsi32_si128(right);
+	const __m128i lcount = _mm_cvtsi32_si128(8 - right);
+	const __m128i rmask = _mm_set1_epi8(0xff >> right);
+	const __m128i lmask = _mm_set1_epi8(0xff << (8 - right) & 0xff);
+	for (; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i r = _mm_and_si128(_mm_srl_epi16(v, rcount), rmask);
+		__m128i l = _mm_and_si128(_mm_sll_epi16(v, lcount), lmask);
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(r, l));
+	}
+#endif
+	for (; i < len; i++)
+		dst[i] = src[i] >> right | src[i] << (8 - right);
+}
+
+void ain_encrypt(uint8_t *dst, const uint8_t *src, size_t len) {
+	rotate_bytes(dst, src, len, 2);
+}
+
+void ain_decrypt(uint8_t *dst, const uint8_t *src, size_t len) {
+	rotate_bytes(dst, src, len, 6);
+}
@@ -0,0 +1,58 @@
+/* Copyright (C) 2026 <KichikuouChrome@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+*/
+
+#undef NDEBUG
+#include "common.h"
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+static void test_ain_encrypt(void) {
+	uint8_t src[256 + 15], enc[256 + 15], dec[256 + 15];
+	for (int i = 0; i < 256; i++)
+		src[i] = i;
+	// Check all lengths and alignments around the 16-byte vector loop.
+	for (int off = 0; off < 15; off++) {
+		for (int len = 0; len <= 256 - off; len += 7) {
+			memset(enc, 0, sizeof(enc));
+			ain_encrypt(enc, src + off, len);
+			for (int i = 0; i < len; i++) {
+				uint8_t c = src[off + i];
+				assert(enc[i] == (uint8_t)(c >> 2 | c << 6));
+			}
+			ain_decrypt(dec + off, enc, len);
+			assert(!memcmp(dec + off, src + off, len));
+		}
+	}
+}
+
+static void test_ain_encrypt_in_place(void) {
+	uint8_t buf[100];
+	for (int i = 0; i < 100; i++)
+		buf[i] = i * 37;
+	ain_encrypt(buf, buf, 100);
+	assert(buf[1] == (37 >> 2 | (37 << 6 & 0xff)));
+	ain_decrypt(buf, buf, 100);
+	for (int i = 0; i < 100; i++)
+		assert(buf[i] == (uint8_t)(i * 37));
+}
+
+void ain_test(void) {
+	test_ain_encrypt();
+	test_ain_encrypt_in_place();
+}
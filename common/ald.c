@@ -27,6 +27,9 @@
 #ifdef _POSIX_MAPPED_FILES
 #include <sys/mman.h>
 #endif
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
 #ifndef _O_BINARY
 #define _O_BINARY 0
 #endif
@@ -34,18 +37,22 @@
 #define ALD_SIGNATURE  0x14c4e
 #define ALD_SIGNATURE2 0x12020
 
-static void write_ptr(int size, int *sector, FILE *fp) {
-	*sector += (size + 0xff) >> 8;
-	fputc(*sector & 0xff, fp);
-	fputc(*sector >> 8 & 0xff, fp);
-	fputc(*sector >> 16 & 0xff, fp);
+#define SECTOR_SIZE 256
+#define SECTOR_ALIGN(n) (((n) + SECTOR_SIZE - 1) & ~(SECTOR_SIZE - 1))
+
+static const uint8_t zeros[SECTOR_SIZE];
+
+static uint8_t *put_le24(uint8_t *p, uint32_t n) {
+	p[0] = n;
+	p[1] = n >> 8;
+	p[2] = n >> 16;
+	return p + 3;
 }
 
-static void pad(FILE *fp) {
-	// Align to next sector boundary
-	long pos = ftell(fp);
-	for (; pos & 0xff; pos++)
-		fputc(0, fp);
+static uint8_t *put_le32(uint8_t *p, uint32_t n) {
+	p = put_le24(p, n);
+	*p++ = n >> 24;
+	return p;
 }
 
 static int entry_header_size(AldEntry *e) {
@@ -53,63 +60,150 @@ static int entry_header_size(AldEntry *e) {
 	return (namelen + 31) & ~0xf;
 }
 
-static void write_entry(AldEntry *entry, FILE *fp) {
-	uint64_t wtime = time_t_to_win_filetime(entry->timestamp);
-	int hdrlen = entry_header_size(entry);
-	fputdw(hdrlen, fp);
-	fputdw(entry->size, fp);
-	fput64(wtime, fp);
-	fputs(entry->name, fp);
-	for (int i = 16 + strlen(entry->name); i < hdrlen; i++)
-		fputc(0, fp);
-	fwrite(entry->data, entry->size, 1, fp);
+typedef struct {
+	const void *base;
+	size_t len;
+} Chunk;
+
+// Writes out the chunks with as few system calls as possible.
+static void write_chunks(Chunk *chunks, int n, FILE *fp) {
+#ifdef _WIN32
+	for (int i = 0; i < n; i++) {
+		if (chunks[i].len && fwrite(chunks[i].base, chunks[i].len, 1, fp) != 1)
+			error("ald_write: %s", strerror(errno));
+	}
+#else
+	if (fflush(fp))
+		error("ald_write: %s", strerror(errno));
+	int fd = fileno(fp);
+	struct iovec iov[256];
+	while (n > 0) {
+		int cnt = n < 256 ? n : 256;
+		for (int i = 0; i < cnt; i++) {
+			iov[i].iov_base = (void *)chunks[i].base;
+			iov[i].iov_len = chunks[i].len;
+		}
+		struct iovec *v = iov;
+		while (cnt > 0) {
+			ssize_t ret = writev(fd, v, cnt);
+			if (ret < 0) {
+				if (errno == EINTR)
+					continue;
+				error("ald_write: %s", strerror(errno));
+			}
+			// Skip over what has been written, then retry the rest.
+			while (cnt > 0 && (size_t)ret >= v->iov_len) {
+				ret -= v->iov_len;
+				v++;
+				cnt--;
+				chunks++;
+				n--;
+			}
+			if (cnt > 0) {
+				v->iov_base = (uint8_t *)v->iov_base + ret;
+				v->iov_len -= ret;
+			}
+		}
+	}
+#endif
 }
 
 void ald_write(Vector *entries, int volume, FILE *fp) {
-	int sector = 0;
-
+	// Every size is known in advance, so the pointer table, the link table and
+	// all entry headers are built in memory first and then written out along
+	// with the entry data in a single pass.
 	int ptr_count = 0;
+	int headers_size = 0;
 	for (int i = 0; i < entries->len; i++) {
 		AldEntry *entry = entries->data[i];
-		if (entry && entry->volume == volume)
+		if (entry && entry->volume == volume) {
 			ptr_count++;
+			headers_size += entry_header_size(entry);
+		}
 	}
 
-	write_ptr((ptr_count + 2) * 3, &sector, fp);
-	write_ptr(entries->len * 3, &sector, fp);
-	for (int i = 0; i < entries->len; i++) {
-		AldEntry *entry = entries->data[i];
-		if (entry && entry->volume == volume)
-			write_ptr(entry_header_size(entry) + entry->size, &sector, fp);
-	}
-	pad(fp);
+	int ptr_table_size = SECTOR_ALIGN((ptr_count + 2) * 3);
+	int link_table_size = SECTOR_ALIGN(entries->len * 3);
+	uint8_t *tables = calloc(1, ptr_table_size + link_table_size + headers_size + 16);
+	if (!tables)
+		error("out of memory");
+	uint8_t *ptr = tables;
+	uint8_t *link = tables + ptr_table_size;
+	uint8_t *hdr = link + link_table_size;
+	uint8_t *footer = hdr + headers_size;
+
+	// entry headers + data + padding for each entry, plus the tables and footer
+	Chunk *chunks = calloc(ptr_count * 3 + 2, sizeof(Chunk));
+	int nr_chunks = 0;
+	chunks[nr_chunks++] = (Chunk){ tables, ptr_table_size + link_table_size };
+
+	int sector = ptr_table_size / SECTOR_SIZE;
+	ptr = put_le24(ptr, sector);
+	sector += link_table_size / SECTOR_SIZE;
+	ptr = put_le24(ptr, sector);
 
-	uint16_t link[256];
-	memset(link, 0, sizeof(link));
+	uint16_t link_no[256] = {0};
 	for (int i = 0; i < entries->len; i++) {
 		AldEntry *entry = entries->data[i];
 		int vol = entry ? entry->volume : 0;
-		fputc(vol, fp);
 		if (vol)
-			link[vol]++;
-		fputc(link[vol] & 0xff, fp);
-		fputc(link[vol] >> 8, fp);
-	}
-	pad(fp);
-
-	for (int i = 0; i < entries->len; i++) {
-		AldEntry *entry = entries->data[i];
-		if (!entry || entry->volume != volume)
+			link_no[vol]++;
+		*link++ = vol;
+		*link++ = link_no[vol] & 0xff;
+		*link++ = link_no[vol] >> 8;
+		if (!entry || vol != volume)
 			continue;
-		write_entry(entry, fp);
-		pad(fp);
+
+		int hdrlen = entry_header_size(entry);
+		put_le32(hdr, hdrlen);
+		put_le32(hdr + 4, entry->size);
+		uint64_t wtime = time_t_to_win_filetime(entry->timestamp);
+		put_le32(hdr + 8, wtime);
+		put_le32(hdr + 12, wtime >> 32);
+		memcpy(hdr + 16, entry->name, strlen(entry->name));  // zero-padded by calloc()
+		chunks[nr_chunks++] = (Chunk){ hdr, hdrlen };
+		chunks[nr_chunks++] = (Chunk){ entry->data, entry->size };
+		chunks[nr_chunks++] = (Chunk){ zeros, SECTOR_ALIGN(hdrlen + entry->size) - (hdrlen + entry->size) };
+		hdr += hdrlen;
+
+		sector += SECTOR_ALIGN(hdrlen + entry->size) / SECTOR_SIZE;
+		ptr = put_le24(ptr, sector);
 	}
 
-	// Footer
-	fputdw(ALD_SIGNATURE, fp);
-	fputdw(0x10, fp);
-	fputdw(ptr_count << 8 | volume, fp);
-	fputdw(0, fp);
+	put_le32(footer, ALD_SIGNATURE);
+	put_le32(footer + 4, 0x10);
+	put_le32(footer + 8, ptr_count << 8 | volume);
+	put_le32(footer + 12, 0);
+	chunks[nr_chunks++] = (Chunk){ footer, 16 };
+
+	write_chunks(chunks, nr_chunks, fp);
+	free(chunks);
+	free(tables);
+}
+
+typedef struct {
+	Vector *entries;
+	char **paths;
+	int volumes[26];
+} AldWriteJob;
+
+static void write_volume(void *data, int i) {
+	AldWriteJob *job = data;
+	int vol = job->volumes[i];
+	FILE *fp = checked_fopen(job->paths[vol], "wb");
+	ald_write(job->entries, vol, fp);
+	if (fclose(fp))
+		error("%s: %s", job->paths[vol], strerror(errno));
+}
+
+void ald_write_volumes(Vector *entries, char *paths[27], int nr_threads) {
+	AldWriteJob job = { .entries = entries, .paths = paths };
+	int n = 0;
+	for (int vol = 1; vol <= 26; vol++) {
+		if (paths[vol])
+			job.volumes[n++] = vol;
+	}
+	parallel_for(n, nr_threads, write_volume, &job);
 }
 
 static inline uint8_t *ald_sector(uint8_t *ald, int size, int index) {
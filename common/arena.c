@@ -0,0 +1,164 @@
+/* Copyright (C) 2026 <KichikuouChrome@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+*/
+#include "common.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MIN_CHUNK_SIZE (4 * 1024)
+#define MAX_CHUNK_SIZE (64 * 1024)
+#define ALIGNMENT 16
+
+typedef struct Chunk {
+	struct Chunk *next;
+	size_t size;
+	size_t used;
+	_Alignas(ALIGNMENT) uint8_t data[];
+} Chunk;
+
+struct Arena {
+	Chunk *chunks;  // the current chunk comes first
+	size_t reserved;  // total size of the chunks
+	ArenaStats stats;
+	struct Arena *next;
+};
+
+// All arenas, for arena_get_stats().
+static Arena *arenas;
+static pthread_mutex_t arenas_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+Arena *new_arena(void) {
+	Arena *a = calloc(1, sizeof(Arena));
+	pthread_mutex_lock(&arenas_mutex);
+	a->next = arenas;
+	arenas = a;
+	pthread_mutex_unlock(&arenas_mutex);
+	return a;
+}
+
+// Frees the arena and everything allocated from it. Its statistics are no
+// longer included in arena_get_stats().
+void free_arena(Arena *a) {
+	pthread_mutex_lock(&arenas_mutex);
+	for (Arena **p = &arenas; *p; p = &(*p)->next) {
+		if (*p == a) {
+			*p = a->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&arenas_mutex);
+	for (Chunk *c = a->chunks; c;) {
+		Chunk *next = c->next;
+		free(c);
+		c = next;
+	}
+	free(a);
+}
+
+static Chunk *new_chunk(Arena *a, size_t size) {
+	Chunk *c = malloc(sizeof(Chunk) + size);
+	if (!c)
+		error("out of memory");
+	c->size = size;
+	c->used = 0;
+	a->reserved += size;
+	if (a->stats.peak_reserved < a->reserved)
+		a->stats.peak_reserved = a->reserved;
+	return c;
+}
+
+// Returns zero-filled memory that lives until the arena is reset.
+void *arena_alloc(Arena *a, size_t size) {
+	size = (size + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1);
+	a->stats.bytes += size;
+	a->stats.count++;
+
+	Chunk *c = a->chunks;
+	if (!c || c->size - c->used < size) {
+		if (size > MAX_CHUNK_SIZE / 4) {
+			// Large objects get their own chunk, so that the current chunk
+			// can still be used for small ones.
+			Chunk *big = new_chunk(a, size);
+			big->used = size;
+			if (c) {
+				big->next = c->next;
+				c->next = big;
+			} else {
+				big->next = NULL;
+				a->chunks = big;
+			}
+			memset(big->data, 0, size);
+			return big->data;
+		}
+		// Chunk sizes grow with the arena, since many arenas (e.g. per-page
+		// ones) stay small.
+		size_t chunk_size = a->reserved < MIN_CHUNK_SIZE ? MIN_CHUNK_SIZE
+			: a->reserved > MAX_CHUNK_SIZE ? MAX_CHUNK_SIZE : a->reserved;
+		if (chunk_size < size)
+			chunk_size = size;
+		c = new_chunk(a, chunk_size);
+		c->next = a->chunks;
+		a->chunks = c;
+	}
+	void *p = c->data + c->used;
+	c->used += size;
+	memset(p, 0, size);
+	return p;
+}
+
+char *arena_strndup(Arena *a, const char *s, size_t n) {
+	char *buf = arena_alloc(a, n + 1);
+	memcpy(buf, s, n);
+	buf[n] = '\0';
+	return buf;
+}
+
+char *arena_strdup(Arena *a, const char *s) {
+	return arena_strndup(a, s, strlen(s));
+}
+
+// Frees everything allocated from the arena. One chunk is kept for reuse.
+// Statistics are not reset.
+void arena_reset(Arena *a) {
+	Chunk *c = a->chunks;
+	if (!c)
+		return;
+	Chunk *next = c->next;
+	while (next) {
+		Chunk *n = next->next;
+		a->reserved -= next->size;
+		free(next);
+		next = n;
+	}
+	c->next = NULL;
+	c->used = 0;
+}
+
+// Returns the sum of the statistics of all arenas. This must not be called
+// while other threads are allocating.
+void arena_get_stats(ArenaStats *stats) {
+	memset(stats, 0, sizeof(ArenaStats));
+	pthread_mutex_lock(&arenas_mutex);
+	for (Arena *a = arenas; a; a = a->next) {
+		stats->bytes += a->stats.bytes;
+		stats->count += a->stats.count;
+		stats->reserved += a->reserved;
+		stats->peak_reserved += a->stats.peak_reserved;
+	}
+	pthread_mutex_unlock(&arenas_mutex);
+}
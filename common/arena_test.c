@@ -0,0 +1,64 @@
+/* Copyright (C) 2026 <KichikuouChrome@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+*/
+
+#undef NDEBUG
+#include "common.h"
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+static bool is_zero(const uint8_t *p, size_t n) {
+	for (size_t i = 0; i < n; i++) {
+		if (p[i])
+			return false;
+	}
+	return true;
+}
+
+void test_arena_alloc(void) {
+	Arena *a = new_arena();
+	uint8_t *prev = NULL;
+	for (int i = 1; i < 1000; i++) {
+		uint8_t *p = arena_alloc(a, i);
+		assert(((uintptr_t)p & 15) == 0);
+		assert(is_zero(p, i));
+		memset(p, 0xff, i);
+		assert(p != prev);
+		prev = p;
+	}
+	uint8_t *big = arena_alloc(a, 100000);
+	assert(is_zero(big, 100000));
+	memset(big, 0xff, 100000);
+
+	char *s = arena_strndup(a, "hello world", 5);
+	assert(!strcmp(s, "hello"));
+	assert(!strcmp(arena_strdup(a, "foo"), "foo"));
+
+	ArenaStats stats;
+	arena_get_stats(&stats);
+	assert(stats.count >= 1002);
+	assert(stats.reserved >= stats.bytes);
+
+	arena_reset(a);
+	uint8_t *p = arena_alloc(a, 100);
+	assert(is_zero(p, 100));
+}
+
+void arena_test(void) {
+	test_arena_alloc();
+}
@@ -0,0 +1,46 @@
+/* Copyright (C) 2026 <KichikuouChrome@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+*/
+#include "common.h"
+#include "command_hash.h"
+#include <string.h>
+
+// Indexed by opcode.
+static const CommandInfo commands[] = {
+#define COMMAND(op, id, name, args, since) [op] = { CMD2F(op), name, args, since },
+#include "commands.def"
+#undef COMMAND
+};
+#define NR_COMMANDS (int)(sizeof(commands) / sizeof(commands[0]))
+
+const CommandInfo *lookup_command(const char *s, int len) {
+	uint32_t seed = command_hash_seeds[command_hash(s, len, 0) % COMMAND_HASH_BUCKETS];
+	int op = command_hash_slots[command_hash(s, len, seed) % COMMAND_HASH_SLOTS];
+	if (op == COMMAND_HASH_EMPTY)
+		return NULL;
+	const CommandInfo *c = &commands[op];
+	if (strncmp(c->name, s, len) || c->name[len])
+		return NULL;
+	return c;
+}
+
+const CommandInfo *command_info(int cmd) {
+	if ((cmd & 0xff) != 0x2f)
+		return NULL;
+	int op = cmd >> 8;
+	return op < NR_COMMANDS ? &commands[op] : NULL;
+}
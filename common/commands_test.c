@@ -0,0 +1,62 @@
+/* Copyright (C) 2026 <KichikuouChrome@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+*/
+#undef NDEBUG
+#include "common.h"
+#include <assert.h>
+#include <string.h>
+
+static const struct {
+	int code;
+	const char *name;
+} names[] = {
+#define COMMAND(op, id, name, args, since) { COMMAND_ ## id, name },
+#include "commands.def"
+#undef COMMAND
+};
+
+static void test_lookup_command(void) {
+	for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++) {
+		const CommandInfo *info = command_info(names[i].code);
+		assert(info);
+		assert(info->code == names[i].code);
+		if (!names[i].name)
+			continue;
+		assert(lookup_command(names[i].name, strlen(names[i].name)) == info);
+	}
+	assert(lookup_command("wavLoad", 7)->code == COMMAND_wavLoad);
+	assert(lookup_command("HH", 2)->code == COMMAND_newHH);
+	assert(lookup_command("LXWHH", 5)->code == COMMAND_LXWHH);
+	assert(lookup_command("LXWHH", 4)->code == COMMAND_LXWH);
+	assert(!lookup_command("wavLoadX", 8));
+	assert(!lookup_command("wavload", 7));
+	assert(!lookup_command("", 0));
+}
+
+static void test_command_info(void) {
+	assert(command_info(COMMAND_TOC)->since == SYSTEM38);
+	assert(!strcmp(command_info(COMMAND_wav3DGetPos)->args, "evvv"));
+	assert(!command_info(COMMAND_ainMsg)->name);
+	assert(!command_info(CMD2F(0xff)));
+	assert(!command_info(CMD2('T', 'A')));
+	assert(!command_info(COMMAND_IF));
+}
+
+void commands_test(void) {
+	test_lookup_command();
+	test_command_info();
+}
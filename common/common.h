@@ -39,13 +39,27 @@ typedef enum {
 	SCO_S380
 } ScoVer;
 
+typedef enum {
+	SYSTEM35,
+	SYSTEM36,
+	SYSTEM38,
+	SYSTEM39,
+} SysVer;
+
 // util.c
 
 void init(int *argc, char ***argv);
 char *strndup_(const char *s, size_t n);
 noreturn void error(char *fmt, ...);
+// Exits the process, or returns from the innermost catch_error() in the
+// calling thread.
+noreturn void error_exit(void);
+// Calls func(data), and returns false if it fails with error() instead of
+// exiting. Memory and files in use at that point are not released.
+bool catch_error(void (*func)(void *data), void *data);
 FILE *checked_fopen(const char *path_utf8, const char *mode);
 int checked_open(const char *path_utf8, int oflag);
+void checked_rename(const char *from_utf8, const char *to_utf8);
 
 char *basename_utf8(const char *path);
 char *dirname_utf8(const char *path);
@@ -68,6 +82,13 @@ uint64_t time_t_to_win_filetime(time_t t);
 #define utf2sjis(s) utf2sjis_sub((s), -1)
 char *sjis2utf_sub(const char *str, int substitution_char);
 char *utf2sjis_sub(const char *str, int substitution_char);
+// Converts a SJIS string to UTF-8. If str contains an invalid SJIS sequence,
+// returns NULL and sets *invalid to the first one.
+char *sjis2utf_checked(const char *str, const char **invalid);
+// Converts len bytes of UTF-8 text to SJIS without allocating memory. dst
+// must have room for len bytes. If compact is true, characters are compacted
+// with compact_sjis(). Returns the number of bytes written.
+int utf2sjis_into(const char *s, int len, uint8_t *dst, bool compact);
 uint8_t compact_sjis(uint8_t c1, uint8_t c2);
 uint16_t expand_sjis(uint8_t c);
 bool is_valid_sjis(uint8_t c1, uint8_t c2);
@@ -104,6 +125,7 @@ typedef struct {
 } Vector;
 
 Vector *new_vec(void);
+void free_vec(Vector *v);
 void vec_push(Vector *v, void *e);
 void vec_set(Vector *v, int index, void *e);
 
@@ -138,11 +160,45 @@ typedef struct {
 } HashMap;
 
 HashMap *new_hash(HashFunc hash, HashKeyCompare compare);
+void free_hash(HashMap *m);
 HashMap *new_string_hash(void);
 void hash_put(HashMap *m, const void *key, const void *val);
 void *hash_get(HashMap *m, const void *key);
 HashItem *hash_iterate(HashMap *m, HashItem *item);
 
+typedef struct Arena Arena;
+typedef struct Interner Interner;
+
+Interner *new_interner(void);
+void free_interner(Interner *in);
+const char *intern(Interner *in, const char *s, size_t len);
+const char *intern_lookup(Interner *in, const char *s, size_t len);
+const char *intern_or_dup(Interner *in, Arena *arena, const char *s, size_t len);
+HashMap *new_hashed_string_hash(void);
+
+// parallel.c
+
+typedef void (*ParallelFunc)(void *data, int index);
+// Calls func(data, i) for each 0 <= i < n, using up to nr_threads threads.
+void parallel_for(int n, int nr_threads, ParallelFunc func, void *data);
+
+// arena.c
+
+typedef struct {
+	size_t bytes;  // total bytes allocated
+	size_t count;  // number of allocations
+	size_t reserved;  // bytes currently obtained from malloc()
+	size_t peak_reserved;
+} ArenaStats;
+
+Arena *new_arena(void);
+void free_arena(Arena *a);
+void *arena_alloc(Arena *a, size_t size);
+char *arena_strdup(Arena *a, const char *s);
+char *arena_strndup(Arena *a, const char *s, size_t n);
+void arena_reset(Arena *a);
+void arena_get_stats(ArenaStats *stats);
+
 // ald.c
 
 typedef struct {
@@ -154,6 +210,9 @@ typedef struct {
 } AldEntry;
 
 void ald_write(Vector *entries, int volume, FILE *fp);
+// Writes volume i to paths[i] for each 1 <= i <= 26 where paths[i] is not
+// NULL, using up to nr_threads threads.
+void ald_write_volumes(Vector *entries, char *paths[27], int nr_threads);
 Vector *ald_read(Vector *entries, const char *path);
 
 // System39.ain
@@ -183,6 +242,12 @@ typedef struct {
 	HELType argtypes[];
 } DLLFunc;
 
+// ain.c
+
+// dst may be the same as src.
+void ain_encrypt(uint8_t *dst, const uint8_t *src, size_t len);
+void ain_decrypt(uint8_t *dst, const uint8_t *src, size_t len);
+
 // opcodes
 
 enum {
@@ -211,150 +276,38 @@ enum {
 #define CMD2F(b) CMD2(0x2f, b)
 
 enum {
-	COMMAND_TOC = CMD2F(0x00),
-	COMMAND_TOS = CMD2F(0x01),
-	COMMAND_TPC = CMD2F(0x02),
-	COMMAND_TPS = CMD2F(0x03),
-	COMMAND_TOP = CMD2F(0x04),
-	COMMAND_TPP = CMD2F(0x05),
-	COMMAND_inc = CMD2F(0x06),
-	COMMAND_dec = CMD2F(0x07),
-	COMMAND_TAA = CMD2F(0x08),
-	COMMAND_TAB = CMD2F(0x09),
-	COMMAND_wavLoad = CMD2F(0x0a),
-	COMMAND_wavPlay = CMD2F(0x0b),
-	COMMAND_wavStop = CMD2F(0x0c),
-	COMMAND_wavUnload = CMD2F(0x0d),
-	COMMAND_wavIsPlay = CMD2F(0x0e),
-	COMMAND_wavFade = CMD2F(0x0f),
-	COMMAND_wavIsFade = CMD2F(0x10),
-	COMMAND_wavStopFade = CMD2F(0x11),
-	COMMAND_trace = CMD2F(0x12),
-	COMMAND_wav3DSetPos = CMD2F(0x13),
-	COMMAND_wav3DCommit = CMD2F(0x14),
-	COMMAND_wav3DGetPos = CMD2F(0x15),
-	COMMAND_wav3DSetPosL = CMD2F(0x16),
-	COMMAND_wav3DGetPosL = CMD2F(0x17),
-	COMMAND_wav3DFadePos = CMD2F(0x18),
-	COMMAND_wav3DIsFadePos = CMD2F(0x19),
-	COMMAND_wav3DStopFadePos = CMD2F(0x1a),
-	COMMAND_wav3DFadePosL = CMD2F(0x1b),
-	COMMAND_wav3DIsFadePosL = CMD2F(0x1c),
-	COMMAND_wav3DStopFadePosL = CMD2F(0x1d),
-	COMMAND_sndPlay = CMD2F(0x1e),
-	COMMAND_sndStop = CMD2F(0x1f),
-	COMMAND_sndIsPlay = CMD2F(0x20),
-	COMMAND_msg = CMD2F(0x21),
-	COMMAND_newHH = CMD2F(0x22),
-	COMMAND_newLC = CMD2F(0x23),
-	COMMAND_newLE = CMD2F(0x24),
-	COMMAND_newLXG = CMD2F(0x25),
-	COMMAND_newMI = CMD2F(0x26),
-	COMMAND_newMS = CMD2F(0x27),
-	COMMAND_newMT = CMD2F(0x28),
-	COMMAND_newNT = CMD2F(0x29),
-	COMMAND_newQE = CMD2F(0x2a),
-	COMMAND_newUP = CMD2F(0x2b),
-	COMMAND_newF = CMD2F(0x2c),
-	COMMAND_wavWaitTime = CMD2F(0x2d),
-	COMMAND_wavGetPlayPos = CMD2F(0x2e),
-	COMMAND_wavWaitEnd = CMD2F(0x2f),
-	COMMAND_wavGetWaveTime = CMD2F(0x30),
-	COMMAND_menuSetCbkSelect = CMD2F(0x31),
-	COMMAND_menuSetCbkCancel = CMD2F(0x32),
-	COMMAND_menuClearCbkSelect = CMD2F(0x33),
-	COMMAND_menuClearCbkCancel = CMD2F(0x34),
-	COMMAND_wav3DSetMode = CMD2F(0x35),
-	COMMAND_grCopyStretch = CMD2F(0x36),
-	COMMAND_grFilterRect = CMD2F(0x37),
-	COMMAND_iptClearWheelCount = CMD2F(0x38),
-	COMMAND_iptGetWheelCount = CMD2F(0x39),
-	COMMAND_menuGetFontSize = CMD2F(0x3a),
-	COMMAND_msgGetFontSize = CMD2F(0x3b),
-	COMMAND_strGetCharType = CMD2F(0x3c),
-	COMMAND_strGetLengthASCII = CMD2F(0x3d),
-	COMMAND_sysWinMsgLock = CMD2F(0x3e),
-	COMMAND_sysWinMsgUnlock = CMD2F(0x3f),
-	COMMAND_aryCmpCount = CMD2F(0x40),
-	COMMAND_aryCmpTrans = CMD2F(0x41),
-	COMMAND_grBlendColorRect = CMD2F(0x42),
-	COMMAND_grDrawFillCircle = CMD2F(0x43),
-	COMMAND_MHH = CMD2F(0x44),
-	COMMAND_menuSetCbkInit = CMD2F(0x45),
-	COMMAND_menuClearCbkInit = CMD2F(0x46),
-	COMMAND_menu = CMD2F(0x47),
-	COMMAND_sysOpenShell = CMD2F(0x48),
-	COMMAND_sysAddWebMenu = CMD2F(0x49),
-	COMMAND_iptSetMoveCursorTime = CMD2F(0x4a),
-	COMMAND_iptGetMoveCursorTime = CMD2F(0x4b),
-	COMMAND_grBlt = CMD2F(0x4c),
-	COMMAND_LXWT = CMD2F(0x4d),
-	COMMAND_LXWS = CMD2F(0x4e),
-	COMMAND_LXWE = CMD2F(0x4f),
-	COMMAND_LXWH = CMD2F(0x50),
-	COMMAND_LXWHH = CMD2F(0x51),
-	COMMAND_sysGetOSName = CMD2F(0x52),
-	COMMAND_patchEC = CMD2F(0x53),
-	COMMAND_mathSetClipWindow = CMD2F(0x54),
-	COMMAND_mathClip = CMD2F(0x55),
-	COMMAND_LXF = CMD2F(0x56),
-	COMMAND_strInputDlg = CMD2F(0x57),
-	COMMAND_strCheckASCII = CMD2F(0x58),
-	COMMAND_strCheckSJIS = CMD2F(0x59),
-	COMMAND_strMessageBox = CMD2F(0x5a),
-	COMMAND_strMessageBoxStr = CMD2F(0x5b),
-	COMMAND_grCopyUseAMapUseA = CMD2F(0x5c),
-	COMMAND_grSetCEParam = CMD2F(0x5d),
-	COMMAND_grEffectMoveView = CMD2F(0x5e),
-	COMMAND_cgSetCacheSize = CMD2F(0x5f),
-	COMMAND_dllCall = CMD2F(0x60),
-	COMMAND_gaijiSet = CMD2F(0x61),
-	COMMAND_gaijiClearAll = CMD2F(0x62),
-	COMMAND_menuGetLatestSelect = CMD2F(0x63),
-	COMMAND_lnkIsLink = CMD2F(0x64),
-	COMMAND_lnkIsData = CMD2F(0x65),
-	COMMAND_fncSetTable = CMD2F(0x66),
-	COMMAND_fncSetTableFromStr = CMD2F(0x67),
-	COMMAND_fncClearTable = CMD2F(0x68),
-	COMMAND_fncCall = CMD2F(0x69),
-	COMMAND_fncSetReturnCode = CMD2F(0x6a),
-	COMMAND_fncGetReturnCode = CMD2F(0x6b),
-	COMMAND_msgSetOutputFlag = CMD2F(0x6c),
-	COMMAND_saveDeleteFile = CMD2F(0x6d),
-	COMMAND_wav3DSetUseFlag = CMD2F(0x6e),
-	COMMAND_wavFadeVolume = CMD2F(0x6f),
-	COMMAND_patchEMEN = CMD2F(0x70),
-	COMMAND_wmenuEnableMsgSkip = CMD2F(0x71),
-	COMMAND_winGetFlipFlag = CMD2F(0x72),
-	COMMAND_cdGetMaxTrack = CMD2F(0x73),
-	COMMAND_dlgErrorOkCancel = CMD2F(0x74),
-	COMMAND_menuReduce = CMD2F(0x75),
-	COMMAND_menuGetNumof = CMD2F(0x76),
-	COMMAND_menuGetText = CMD2F(0x77),
-	COMMAND_menuGoto = CMD2F(0x78),
-	COMMAND_menuReturnGoto = CMD2F(0x79),
-	COMMAND_menuFreeShelterDIB = CMD2F(0x7a),
-	COMMAND_msgFreeShelterDIB = CMD2F(0x7b),
-	COMMAND_ainMsg = CMD2F(0x7c),
-	COMMAND_ainH = CMD2F(0x7d),
-	COMMAND_ainHH = CMD2F(0x7e),
-	COMMAND_ainX = CMD2F(0x7f),
-	COMMAND_dataSetPointer = CMD2F(0x80),
-	COMMAND_dataGetWORD = CMD2F(0x81),
-	COMMAND_dataGetString = CMD2F(0x82),
-	COMMAND_dataSkipWORD = CMD2F(0x83),
-	COMMAND_dataSkipString = CMD2F(0x84),
-	COMMAND_varGetNumof = CMD2F(0x85),
-	COMMAND_patchG0 = CMD2F(0x86),
-	COMMAND_regReadString = CMD2F(0x87),
-	COMMAND_fileCheckExist = CMD2F(0x88),
-	COMMAND_timeCheckCurDate = CMD2F(0x89),
-	COMMAND_dlgManualProtect = CMD2F(0x8a),
-	COMMAND_fileCheckDVD = CMD2F(0x8b),
-	COMMAND_sysReset = CMD2F(0x8c),
+#define COMMAND(op, id, name, args, since) COMMAND_ ## id = CMD2F(op),
+#include "commands.def"
+#undef COMMAND
 	// Pseudo commands
 	COMMAND_IF = 0x80,
 	COMMAND_LXWx = 0x81,
 	COMMAND_CONST = 0x82,
 	COMMAND_PRAGMA = 0x83,
 };
+
+// commands.c
+
+typedef struct {
+	int code;          // COMMAND_*
+	const char *name;  // NULL if the command has no name
+	const char *args;  // NULL if the arguments need special handling
+	SysVer since;
+} CommandInfo;
+
+// Returns the command named s[0..len), or NULL.
+const CommandInfo *lookup_command(const char *s, int len);
+// Returns the CommandInfo for a COMMAND_* code, or NULL if cmd is not a "/xx"
+// command.
+const CommandInfo *command_info(int cmd);
+
+// The hash function for lookup_command(), shared with mkcmdhash.c.
+static inline uint32_t command_hash(const char *s, int len, uint32_t seed) {
+	uint32_t h = 2166136261u ^ seed;
+	for (int i = 0; i < len; i++)
+		h = (h ^ (uint8_t)s[i]) * 16777619u;
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	return h;
+}
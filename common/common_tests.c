@@ -16,12 +16,20 @@
  *
 */
 
+void ain_test(void);
 void ald_test(void);
+void arena_test(void);
+void commands_test(void);
+void container_test(void);
 void sjisutf_test(void);
 void util_test(void);
 
 int main() {
+	ain_test();
 	ald_test();
+	arena_test();
+	commands_test();
+	container_test();
 	sjisutf_test();
 	util_test();
 }
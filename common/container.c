@@ -16,6 +16,7 @@
  *
 */
 #include "common.h"
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -29,6 +30,15 @@ Vector *new_vec(void) {
 	return v;
 }
 
+// Most vectors live until xsys35c exits. This is for the few that do not,
+// such as those of a long-running compile server. v may be NULL.
+void free_vec(Vector *v) {
+	if (!v)
+		return;
+	free(v->data);
+	free(v);
+}
+
 void vec_push(Vector *v, void *e) {
 	if (v->len == v->cap) {
 		v->cap *= 2;
@@ -87,16 +97,26 @@ HashMap *new_hash(HashFunc hash, HashKeyCompare compare) {
 	return m;
 }
 
-static uint32_t string_hash(const char *p) {
+// Frees the table, but not the keys and values.
+void free_hash(HashMap *m) {
+	free(m->table);
+	free(m);
+}
+
+static uint32_t string_hash_n(const char *p, size_t len) {
 	// FNV hash
 	uint32_t r = 2166136261;
-	for (; *p; p++) {
+	for (const char *end = p + len; p < end; p++) {
 		r ^= *p;
 		r *= 16777619;
 	}
 	return r;
 }
 
+static uint32_t string_hash(const char *p) {
+	return string_hash_n(p, strlen(p));
+}
+
 HashMap *new_string_hash(void) {
 	return new_hash((HashFunc)string_hash, (HashKeyCompare)strcmp);
 }
@@ -149,3 +169,115 @@ HashItem *hash_iterate(HashMap *m, HashItem *item) {
 	}
 	return NULL;
 }
+
+// Hashed strings. The hash of the string is stored just before it, so that
+// hash tables don't need to compute it again for every lookup.
+
+typedef struct {
+	uint32_t hash;
+	char str[];
+} HashedString;
+
+#define HASHED_STRING(s) ((const HashedString *)((s) - offsetof(HashedString, str)))
+
+static const char *new_hashed_string(Arena *arena, const char *s, size_t len, uint32_t hash) {
+	HashedString *hs = arena_alloc(arena, sizeof(HashedString) + len + 1);
+	hs->hash = hash;
+	memcpy(hs->str, s, len);
+	hs->str[len] = '\0';
+	return hs->str;
+}
+
+static uint32_t hashed_string_hash(const char *s) {
+	return HASHED_STRING(s)->hash;
+}
+
+static int hashed_string_compare(const char *s1, const char *s2) {
+	if (s1 == s2)
+		return 0;  // fast path for interned strings
+	if (HASHED_STRING(s1)->hash != HASHED_STRING(s2)->hash)
+		return 1;
+	return strcmp(s1, s2);
+}
+
+// Returns a HashMap whose keys are strings returned by intern(),
+// intern_lookup() or intern_or_dup(). Hash values are the same as
+// new_string_hash(), so the iteration order is the same too.
+HashMap *new_hashed_string_hash(void) {
+	return new_hash((HashFunc)hashed_string_hash, (HashKeyCompare)hashed_string_compare);
+}
+
+struct Interner {
+	Arena *arena;
+	const char **table;
+	uint32_t size;
+	uint32_t occupied;
+};
+
+Interner *new_interner(void) {
+	Interner *in = calloc(1, sizeof(Interner));
+	in->arena = new_arena();
+	in->size = HASH_INIT_SIZE;
+	in->table = calloc(in->size, sizeof(const char *));
+	return in;
+}
+
+// Frees the interner and all the strings interned in it.
+void free_interner(Interner *in) {
+	free_arena(in->arena);
+	free(in->table);
+	free(in);
+}
+
+static const char **intern_find(Interner *in, const char *s, size_t len, uint32_t hash) {
+	uint32_t h = hash & (in->size - 1);
+	while (in->table[h]) {
+		const char *t = in->table[h];
+		if (HASHED_STRING(t)->hash == hash && !strncmp(t, s, len) && !t[len])
+			break;
+		if (++h == in->size)
+			h = 0;
+	}
+	return &in->table[h];
+}
+
+// Returns the unique copy of s[0..len). Not thread-safe.
+const char *intern(Interner *in, const char *s, size_t len) {
+	if (in->occupied * 4 >= in->size * 3) {
+		const char **old = in->table;
+		uint32_t old_size = in->size;
+		in->size *= 2;
+		in->table = calloc(in->size, sizeof(const char *));
+		for (uint32_t i = 0; i < old_size; i++) {
+			if (old[i])
+				*intern_find(in, old[i], strlen(old[i]), HASHED_STRING(old[i])->hash) = old[i];
+		}
+		free(old);
+	}
+	uint32_t hash = string_hash_n(s, len);
+	const char **slot = intern_find(in, s, len, hash);
+	if (!*slot) {
+		*slot = new_hashed_string(in->arena, s, len, hash);
+		in->occupied++;
+	}
+	return *slot;
+}
+
+// Returns the interned copy of s[0..len), or NULL if it is not interned. This
+// can be called from multiple threads as long as no one calls intern().
+const char *intern_lookup(Interner *in, const char *s, size_t len) {
+	return *intern_find(in, s, len, string_hash_n(s, len));
+}
+
+// Returns the interned copy of s[0..len) if there is one. Otherwise returns a
+// new hashed string allocated from arena, which can be used as a key of
+// new_hashed_string_hash() but is not unique. in may be NULL.
+const char *intern_or_dup(Interner *in, Arena *arena, const char *s, size_t len) {
+	uint32_t hash = string_hash_n(s, len);
+	if (in) {
+		const char *p = *intern_find(in, s, len, hash);
+		if (p)
+			return p;
+	}
+	return new_hashed_string(arena, s, len, hash);
+}
@@ -0,0 +1,59 @@
+/* Copyright (C) 2026 <KichikuouChrome@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+*/
+
+#undef NDEBUG
+#include "common.h"
+#include <assert.h>
+#include <string.h>
+
+void test_intern(void) {
+	Interner *in = new_interner();
+	const char *foo = intern(in, "foobar", 3);
+	assert(!strcmp(foo, "foo"));
+	assert(intern(in, "foo", 3) == foo);
+	assert(intern_lookup(in, "foo", 3) == foo);
+	assert(!intern_lookup(in, "fo", 2));
+	assert(!intern_lookup(in, "foob", 4));
+
+	// Make sure that interned strings survive rehashing.
+	char buf[16];
+	for (int i = 0; i < 1000; i++) {
+		sprintf(buf, "s%d", i);
+		intern(in, buf, strlen(buf));
+	}
+	assert(intern_lookup(in, "foo", 3) == foo);
+	assert(!strcmp(intern_lookup(in, "s999", 4), "s999"));
+
+	Arena *arena = new_arena();
+	assert(intern_or_dup(in, arena, "foo", 3) == foo);
+	const char *bar = intern_or_dup(in, arena, "bar", 3);
+	assert(!strcmp(bar, "bar"));
+	assert(intern_or_dup(NULL, arena, "foo", 3) != foo);
+
+	// Interned and non-interned copies are the same key.
+	HashMap *m = new_hashed_string_hash();
+	hash_put(m, foo, "1");
+	hash_put(m, bar, "2");
+	assert(!strcmp(hash_get(m, intern_or_dup(NULL, arena, "foo", 3)), "1"));
+	assert(!strcmp(hash_get(m, intern_or_dup(in, arena, "bar", 3)), "2"));
+	assert(!hash_get(m, intern_or_dup(in, arena, "baz", 3)));
+}
+
+void container_test(void) {
+	test_intern();
+}
@@ -0,0 +1,131 @@
+/* Copyright (C) 2026 <KichikuouChrome@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+*/
+
+// Generates a perfect hash table of the command names in commands.def, used
+// by lookup_command(). This runs at build time.
+//
+// The names are first distributed into buckets by command_hash(name, 0).
+// Then, starting from the largest bucket, a seed is searched for each bucket
+// such that command_hash(name, seed) maps every name in the bucket to a free
+// slot. A lookup computes two hashes and compares one name.
+
+#include "common.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define NR_BUCKETS 64
+#define NR_SLOTS 256
+#define EMPTY 0xff
+#define MAX_SEED 0xffff
+
+static const char *names[] = {
+#define COMMAND(op, id, name, args, since) [op] = name,
+#include "commands.def"
+#undef COMMAND
+};
+#define NR_COMMANDS (int)(sizeof(names) / sizeof(names[0]))
+
+static int bucket_of(int op) {
+	return command_hash(names[op], strlen(names[op]), 0) % NR_BUCKETS;
+}
+
+static int slot_of(int op, uint32_t seed) {
+	return command_hash(names[op], strlen(names[op]), seed) % NR_SLOTS;
+}
+
+static bool try_seed(const int *ops, int n, uint32_t seed, const uint8_t *slots) {
+	for (int i = 0; i < n; i++) {
+		int s = slot_of(ops[i], seed);
+		if (slots[s] != EMPTY)
+			return false;
+		for (int j = 0; j < i; j++) {
+			if (slot_of(ops[j], seed) == s)
+				return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	if (argc != 2) {
+		fprintf(stderr, "Usage: %s output\n", argv[0]);
+		return 1;
+	}
+	if (NR_COMMANDS >= EMPTY) {
+		fprintf(stderr, "mkcmdhash: too many commands\n");
+		return 1;
+	}
+
+	int buckets[NR_BUCKETS][NR_COMMANDS];
+	int bucket_size[NR_BUCKETS] = {0};
+	for (int op = 0; op < NR_COMMANDS; op++) {
+		if (!names[op])
+			continue;
+		int b = bucket_of(op);
+		buckets[b][bucket_size[b]++] = op;
+	}
+
+	uint16_t seeds[NR_BUCKETS] = {0};
+	uint8_t slots[NR_SLOTS];
+	memset(slots, EMPTY, sizeof(slots));
+	bool done[NR_BUCKETS] = {false};
+	for (;;) {
+		int b = -1;
+		for (int i = 0; i < NR_BUCKETS; i++) {
+			if (!done[i] && bucket_size[i] && (b < 0 || bucket_size[i] > bucket_size[b]))
+				b = i;
+		}
+		if (b < 0)
+			break;
+		uint32_t seed = 1;
+		while (!try_seed(buckets[b], bucket_size[b], seed, slots)) {
+			if (++seed > MAX_SEED) {
+				fprintf(stderr, "mkcmdhash: cannot find a perfect hash\n");
+				return 1;
+			}
+		}
+		for (int i = 0; i < bucket_size[b]; i++)
+			slots[slot_of(buckets[b][i], seed)] = buckets[b][i];
+		seeds[b] = seed;
+		done[b] = true;
+	}
+
+	FILE *fp = fopen(argv[1], "w");
+	if (!fp) {
+		perror(argv[1]);
+		return 1;
+	}
+	fprintf(fp, "// Generated by mkcmdhash from commands.def. Do not edit.\n\n");
+	fprintf(fp, "#define COMMAND_HASH_BUCKETS %d\n", NR_BUCKETS);
+	fprintf(fp, "#define COMMAND_HASH_SLOTS %d\n", NR_SLOTS);
+	fprintf(fp, "#define COMMAND_HASH_EMPTY 0x%02x\n\n", EMPTY);
+	fprintf(fp, "static const uint16_t command_hash_seeds[COMMAND_HASH_BUCKETS] = {");
+	for (int i = 0; i < NR_BUCKETS; i++)
+		fprintf(fp, "%s%d,", i % 16 ? " " : "\n\t", seeds[i]);
+	fprintf(fp, "\n};\n\n");
+	fprintf(fp, "// Opcodes of the commands, indexed by command_hash(name, seed).\n");
+	fprintf(fp, "static const uint8_t command_hash_slots[COMMAND_HASH_SLOTS] = {");
+	for (int i = 0; i < NR_SLOTS; i++)
+		fprintf(fp, "%s0x%02x,", i % 16 ? " " : "\n\t", slots[i]);
+	fprintf(fp, "\n};\n");
+	if (fclose(fp)) {
+		perror(argv[1]);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,89 @@
+/* Copyright (C) 2026 <KichikuouChrome@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+*/
+
+// Generates the Unicode to SJIS table (the reverse of s2utbl.h) used by
+// utf2sjis(). This runs at build time.
+//
+// The table is split into 256-entry blocks by the upper byte of the
+// codepoint, and blocks that are identical (mostly the empty ones) are
+// stored once:
+//
+//   sjis = u2s_blocks[u2s_index[u >> 8]][u & 0xff]
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "s2utbl.h"
+
+static uint16_t u2s[0x10000];
+static uint16_t blocks[256][256];
+static uint8_t block_index[256];
+
+int main(int argc, char *argv[]) {
+	if (argc != 2) {
+		fprintf(stderr, "Usage: %s output\n", argv[0]);
+		return 1;
+	}
+
+	// If a codepoint is mapped from multiple SJIS characters, the first one
+	// is used.
+	for (int b1 = 0x81; b1 <= 0xfe; b1++) {
+		for (int b2 = 0x40; b2 <= 0xfe; b2++) {
+			uint16_t u = s2u[b1 - 0x80][b2 - 0x40];
+			if (u && !u2s[u])
+				u2s[u] = b1 << 8 | b2;
+		}
+	}
+
+	int nr_blocks = 1;  // block 0 is all zeros
+	for (int hi = 0; hi < 256; hi++) {
+		const uint16_t *block = &u2s[hi << 8];
+		int i;
+		for (i = 0; i < nr_blocks; i++) {
+			if (!memcmp(blocks[i], block, sizeof(blocks[i])))
+				break;
+		}
+		if (i == nr_blocks)
+			memcpy(blocks[nr_blocks++], block, sizeof(blocks[i]));
+		block_index[hi] = i;
+	}
+
+	FILE *fp = fopen(argv[1], "w");
+	if (!fp) {
+		perror(argv[1]);
+		return 1;
+	}
+	fprintf(fp, "// Generated by mku2s from s2utbl.h. Do not edit.\n\n");
+	fprintf(fp, "static const uint8_t u2s_index[256] = {");
+	for (int i = 0; i < 256; i++)
+		fprintf(fp, "%s%d,", i % 16 ? " " : "\n\t", block_index[i]);
+	fprintf(fp, "\n};\n\n");
+	fprintf(fp, "static const uint16_t u2s_blocks[%d][256] = {\n", nr_blocks);
+	for (int b = 0; b < nr_blocks; b++) {
+		fprintf(fp, "\t{");
+		for (int i = 0; i < 256; i++)
+			fprintf(fp, "%s0x%04x,", i % 8 ? " " : "\n\t\t", blocks[b][i]);
+		fprintf(fp, "\n\t},\n");
+	}
+	fprintf(fp, "};\n");
+	if (fclose(fp)) {
+		perror(argv[1]);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,70 @@
+/* Copyright (C) 2026 <KichikuouChrome@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+*/
+#include "common.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+typedef struct {
+	ParallelFunc func;
+	void *data;
+	int n;
+	int next;
+	pthread_mutex_t mutex;
+} Job;
+
+static void *worker(void *arg) {
+	Job *job = arg;
+	for (;;) {
+		pthread_mutex_lock(&job->mutex);
+		int i = job->next++;
+		pthread_mutex_unlock(&job->mutex);
+		if (i >= job->n)
+			break;
+		job->func(job->data, i);
+	}
+	return NULL;
+}
+
+void parallel_for(int n, int nr_threads, ParallelFunc func, void *data) {
+	if (nr_threads > n)
+		nr_threads = n;
+	if (nr_threads <= 1) {
+		for (int i = 0; i < n; i++)
+			func(data, i);
+		return;
+	}
+
+	Job job = { .func = func, .data = data, .n = n, .next = 0 };
+	pthread_mutex_init(&job.mutex, NULL);
+
+	// The calling thread works as one of the workers. If a thread cannot be
+	// created, the remaining workers (at least the caller) take over its share.
+	pthread_t *threads = calloc(nr_threads - 1, sizeof(pthread_t));
+	int nr_started = 0;
+	while (nr_started < nr_threads - 1) {
+		if (pthread_create(&threads[nr_started], NULL, worker, &job))
+			break;
+		nr_started++;
+	}
+	worker(&job);
+	for (int i = 0; i < nr_started; i++)
+		pthread_join(threads[i], NULL);
+
+	free(threads);
+	pthread_mutex_destroy(&job.mutex);
+}
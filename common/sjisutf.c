@@ -17,10 +17,15 @@
 */
 #include "common.h"
 #include "s2utbl.h"
+#include "u2stbl.h"
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 static const uint8_t hankaku81[] = {
 	0x20, 0xa4, 0xa1, 0x00, 0x00, 0xa5, 0x00, 0x00,
 	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
@@ -146,77 +151,121 @@ static int unicode_to_sjis(int u) {
 		return u;
 	if (u > 0xffff)
 		return 0;
-
-	static uint16_t *u2s = NULL;
-	if (!u2s) {
-		// Create a reverse lookup table from s2u.
-		u2s = calloc(0x10000, sizeof(uint16_t));
-		for (int b1 = 0x81; b1 <= 0xfe; b1++) {
-			//if (b1 >= 0xa0 && b1 <= 0xdf)
-			//	continue;
-			for (int b2 = 0x40; b2 <= 0xfe; b2++) {
-				uint16_t u = s2u[b1 - 0x80][b2 - 0x40];
-				if (u && !u2s[u])
-					u2s[u] = b1 << 8 | b2;
-			}
-		}
-	}
-	return u2s[u];
+	return u2s_blocks[u2s_index[u >> 8]][u & 0xff];
 }
 
 bool is_valid_sjis(uint8_t c1, uint8_t c2) {
 	return is_sjis_byte1(c1) && is_sjis_byte2(c2) && s2u[c1 - 0x80][c2 - 0x40];
 }
 
-char *sjis2utf_sub(const char *str, int substitution_char) {
+static uint8_t *put_utf8(uint8_t *p, int c) {
+	if (c <= 0x7f) {
+		*p++ = c;
+	} else if (c <= 0x7ff) {
+		*p++ = 0xc0 | c >> 6;
+		*p++ = 0x80 | (c & 0x3f);
+	} else {
+		*p++ = 0xe0 | c >> 12;
+		*p++ = 0x80 | (c >> 6 & 0x3f);
+		*p++ = 0x80 | (c & 0x3f);
+	}
+	return p;
+}
+
+// Converts str to UTF-8 in a single pass. Invalid SJIS sequences are replaced
+// with substitution_char if it is not negative. Otherwise, if invalid is not
+// NULL, the conversion stops, *invalid is set to the sequence and NULL is
+// returned. Otherwise, it is an error.
+static char *convert_sjis(const char *str, int substitution_char, const char **invalid) {
+	size_t len = strlen(str);
+	// A two-byte SJIS character is at most three bytes in UTF-8. A substituted
+	// single byte can be up to three bytes too.
+	size_t max_len = substitution_char < 0 ? len + len / 2 : len * 3;
 	const uint8_t *src = (uint8_t *)str;
-	uint8_t *dst = malloc(strlen(str) * 3 + 1);
+	const uint8_t *end = src + len;
+	uint8_t *dst = malloc(max_len + 1);
 	uint8_t *dstp = dst;
 
-	while (*src) {
+	while (src < end) {
+#ifdef __SSE2__
+		// Copy runs of ASCII characters 16 bytes at a time.
+		while (end - src >= 16) {
+			__m128i v = _mm_loadu_si128((const __m128i *)src);
+			unsigned mask = _mm_movemask_epi8(v);
+			if (mask) {
+				int n = __builtin_ctz(mask);
+				memcpy(dstp, src, n);
+				dstp += n;
+				src += n;
+				break;
+			}
+			_mm_storeu_si128((__m128i *)dstp, v);
+			dstp += 16;
+			src += 16;
+		}
+		if (src == end)
+			break;
+#endif
 		if (*src <= 0x7f) {
 			*dstp++ = *src++;
 			continue;
 		}
 
 		int c;
-		/*if (*src >= 0xa0 && *src <= 0xdf) {
-			c = 0xff60 + *src - 0xa0;
-			src++;
-		} else */
 		if (is_valid_sjis(src[0], src[1])) {
 			c = s2u[src[0] - 0x80][src[1] - 0x40];
 			src += 2;
 		} else {
-			if (substitution_char < 0)
+			if (substitution_char < 0) {
+				if (invalid) {
+					*invalid = (const char *)src;
+					free(dst);
+					return NULL;
+				}
 				error("Invalid SJIS byte sequence %02x %02x", src[0], src[1]);
+			}
 			c = substitution_char;
 			src++;
 		}
-
-		if (c <= 0x7f) {
-			*dstp++ = c;
-		} else if (c <= 0x7ff) {
-			*dstp++ = 0xc0 | c >> 6;
-			*dstp++ = 0x80 | (c & 0x3f);
-		} else {
-			*dstp++ = 0xe0 | c >> 12;
-			*dstp++ = 0x80 | (c >> 6 & 0x3f);
-			*dstp++ = 0x80 | (c & 0x3f);
-		}
+		dstp = put_utf8(dstp, c);
 	}
-	*dstp = '\0';
-	return (char *)dst;
+	*dstp++ = '\0';
+	return realloc(dst, dstp - dst);
 }
 
-char *utf2sjis_sub(const char *str, int substitution_char) {
-	const uint8_t *src = (uint8_t *)str;
-	uint8_t *dst = malloc(strlen(str) + 1);
-	uint8_t *dstp = dst;
+char *sjis2utf_sub(const char *str, int substitution_char) {
+	return convert_sjis(str, substitution_char, NULL);
+}
+
+char *sjis2utf_checked(const char *str, const char **invalid) {
+	return convert_sjis(str, -1, invalid);
+}
 
-	while (*src) {
+// Converts UTF-8 text in [src, end) to SJIS, writing to dst, and returns the
+// end of the output. The output is never longer than the input.
+static uint8_t *convert_utf8(const uint8_t *src, const uint8_t *end, uint8_t *dst, int substitution_char, bool compact) {
+	while (src < end) {
+#ifdef __SSE2__
+		// Copy runs of ASCII characters 16 bytes at a time.
+		while (end - src >= 16) {
+			__m128i v = _mm_loadu_si128((const __m128i *)src);
+			unsigned mask = _mm_movemask_epi8(v);
+			if (mask) {
+				int n = __builtin_ctz(mask);
+				memcpy(dst, src, n);
+				dst += n;
+				src += n;
+				break;
+			}
+			_mm_storeu_si128((__m128i *)dst, v);
+			dst += 16;
+			src += 16;
+		}
+		if (src >= end)
+			break;
+#endif
 		if (*src <= 0x7f) {
-			*dstp++ = *src++;
+			*dst++ = *src++;
 			continue;
 		}
 
@@ -230,31 +279,59 @@ char *utf2sjis_sub(const char *str, int substitution_char) {
 		} else {
 			if (substitution_char < 0)
 				error("Unsupported UTF-8 sequence");
-			*dstp++ = substitution_char;
-			do src++; while ((*src & 0xc0) == 0x80);
+			*dst++ = substitution_char;
+			do src++; while (src < end && (*src & 0xc0) == 0x80);
 			continue;
 		}
 
-		/*if (u > 0xff60 && u <= 0xff9f) {
-			*dstp++ = u - 0xff60 + 0xa0;
-		} else {*/
-			int c = unicode_to_sjis(u);
-			if (c) {
-				*dstp++ = c >> 8;
-				*dstp++ = c & 0xff;
-			} else {
-				if (substitution_char < 0)
-					error("Codepoint U+%04X cannot be converted to Shift_JIS", u);
-				*dstp++ = substitution_char;
-			}
-		//}
+		int c = unicode_to_sjis(u);
+		if (!c) {
+			if (substitution_char < 0)
+				error("Codepoint U+%04X cannot be converted to Shift_JIS", u);
+			*dst++ = substitution_char;
+			continue;
+		}
+		uint8_t hk = compact ? compact_sjis(c >> 8, c & 0xff) : 0;
+		if (hk) {
+			*dst++ = hk;
+		} else {
+			*dst++ = c >> 8;
+			*dst++ = c & 0xff;
+		}
 	}
-	*dstp = '\0';
-	return (char*)dst;
+	return dst;
+}
+
+char *utf2sjis_sub(const char *str, int substitution_char) {
+	size_t len = strlen(str);
+	uint8_t *dst = malloc(len + 1);
+	uint8_t *end = convert_utf8((const uint8_t *)str, (const uint8_t *)str + len, dst, substitution_char, false);
+	*end = '\0';
+	return (char *)dst;
+}
+
+int utf2sjis_into(const char *s, int len, uint8_t *dst, bool compact) {
+	return convert_utf8((const uint8_t *)s, (const uint8_t *)s + len, dst, -1, compact) - dst;
 }
 
 const char *validate_utf8(const char *s) {
+#ifdef __SSE2__
+	const char *end = s + strlen(s);
+#endif
 	while (*s) {
+#ifdef __SSE2__
+		// Skip runs of ASCII characters 16 bytes at a time.
+		while (end - s >= 16) {
+			unsigned mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)s));
+			if (mask) {
+				s += __builtin_ctz(mask);
+				break;
+			}
+			s += 16;
+		}
+		if (!*s)
+			break;
+#endif
 		if ((uint8_t)*s <= 0x7f) {
 			s++;
 		} else if ((uint8_t)*s <= 0xbf) {
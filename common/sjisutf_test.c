@@ -18,6 +18,7 @@
 #include "common.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 static void test_compaction(void) {
 	for (int c = 0; c < 256; c++) {
@@ -53,6 +54,70 @@ static void test_compaction(void) {
 	}
 }
 
+static void test_sjis2utf_checked(void) {
+	// Long enough to take the 16-byte ASCII path.
+	const char *valid = "abcdefghijklmnopqrstuvwxyz\x82\xa0\x82\xa2 0123456789ABCDEFGHIJ\x81\x40";
+	const char *invalid = NULL;
+	char *utf = sjis2utf_checked(valid, &invalid);
+	if (!utf || strcmp(utf, sjis2utf(valid)) || invalid) {
+		printf("[FAIL] sjis2utf_checked: unexpected result for a valid string\n");
+		exit(1);
+	}
+
+	const char *s = "0123456789abcdefghij\x82\xa0xyz\x81\x20";
+	utf = sjis2utf_checked(s, &invalid);
+	if (utf || invalid != s + 25) {
+		printf("[FAIL] sjis2utf_checked: expected an error at 25, got %d\n", invalid ? (int)(invalid - s) : -1);
+		exit(1);
+	}
+}
+
+static void test_validate_utf8(void) {
+	const char *valid = "abcdefghijklmnopqrstuvwxyz\xe3\x81\x82 0123456789ABCDEFGHIJ\xc3\xa9";
+	if (validate_utf8(valid)) {
+		printf("[FAIL] validate_utf8: unexpected error for a valid string\n");
+		exit(1);
+	}
+	const char *s = "abcdefghijklmnopqrstuvwxyz\xe3\x81\x82\x81xyz";
+	const char *err = validate_utf8(s);
+	if (err != s + 29) {
+		printf("[FAIL] validate_utf8: expected an error at 29, got %d\n", err ? (int)(err - s) : -1);
+		exit(1);
+	}
+}
+
+static void test_utf2sjis(void) {
+	const char *ascii = "The quick brown fox jumps over the lazy dog. 0123456789";
+	if (strcmp(utf2sjis(ascii), ascii)) {
+		printf("[FAIL] utf2sjis: ASCII string is not preserved\n");
+		exit(1);
+	}
+	// Every character must survive a round trip (a codepoint that has
+	// multiple SJIS codes is converted to one of them).
+	for (int c1 = 0x81; c1 <= 0xfe; c1++) {
+		for (int c2 = 0x40; c2 <= 0xfe; c2++) {
+			if (!is_valid_sjis(c1, c2))
+				continue;
+			char sjis[] = { c1, c2, 0 };
+			char *utf = sjis2utf(sjis);
+			char *back = utf2sjis_sub(utf, '?');
+			if (strcmp(sjis2utf_sub(back, '?'), utf)) {
+				printf("[FAIL] utf2sjis(sjis2utf(%02x %02x)) = %02x %02x\n", c1, c2, (uint8_t)back[0], (uint8_t)back[1]);
+				exit(1);
+			}
+			uint8_t buf[4];
+			int n = utf2sjis_into(utf, strlen(utf), buf, false);
+			if (n != (int)strlen(back) || memcmp(buf, back, n)) {
+				printf("[FAIL] utf2sjis_into(sjis2utf(%02x %02x)) differs from utf2sjis\n", c1, c2);
+				exit(1);
+			}
+		}
+	}
+}
+
 void sjisutf_test(void) {
+	test_sjis2utf_checked();
+	test_utf2sjis();
+	test_validate_utf8();
 	test_compaction();
 }
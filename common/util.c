@@ -18,6 +18,7 @@
 #include "common.h"
 #include <errno.h>
 #include <fcntl.h>
+#include <setjmp.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
@@ -65,12 +66,32 @@ char *strndup_(const char *s, size_t n) {
 	return buf;
 }
 
+// Set while catch_error() is running in this thread.
+static _Thread_local jmp_buf *error_jmp;
+
+noreturn void error_exit(void) {
+	if (error_jmp)
+		longjmp(*error_jmp, 1);
+	exit(1);
+}
+
+bool catch_error(void (*func)(void *data), void *data) {
+	jmp_buf buf;
+	jmp_buf *saved = error_jmp;
+	error_jmp = &buf;
+	bool ok = !setjmp(buf);
+	if (ok)
+		func(data);
+	error_jmp = saved;
+	return ok;
+}
+
 noreturn void error(char *fmt, ...) {
 	va_list args;
 	va_start(args, fmt);
 	vfprintf(stderr, fmt, args);
 	fprintf(stderr, "\n");
-	exit(1);
+	error_exit();
 }
 
 FILE *checked_fopen(const char *path_utf8, const char *mode) {
@@ -103,6 +124,22 @@ int checked_open(const char *path_utf8, int oflag) {
 	return fd;
 }
 
+// Renames from to to, replacing to if it exists.
+void checked_rename(const char *from_utf8, const char *to_utf8) {
+#ifdef _WIN32
+	wchar_t wfrom[PATH_MAX + 1], wto[PATH_MAX + 1];
+	if (!MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, from_utf8, -1, wfrom, PATH_MAX + 1))
+		error("MultiByteToWideChar(\"%s\") failed with error code 0x%x", from_utf8, GetLastError());
+	if (!MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, to_utf8, -1, wto, PATH_MAX + 1))
+		error("MultiByteToWideChar(\"%s\") failed with error code 0x%x", to_utf8, GetLastError());
+	if (!MoveFileExW(wfrom, wto, MOVEFILE_REPLACE_EXISTING))
+		error("cannot rename %s to %s: error code 0x%x", from_utf8, to_utf8, GetLastError());
+#else
+	if (rename(from_utf8, to_utf8) != 0)
+		error("cannot rename %s to %s: %s", from_utf8, to_utf8, strerror(errno));
+#endif
+}
+
 static inline bool is_path_separator(char c) {
 #ifdef _WIN32
 	return c == '/' || c == '\\';
@@ -63,7 +63,36 @@ void test_basename_utf8(void) {
 #endif
 }
 
+static void fail(void *data) {
+	*(int *)data += 1;
+	error("catch_error test: this error is expected");
+	*(int *)data += 1;
+}
+
+static void succeed(void *data) {
+	*(int *)data += 1;
+}
+
+static void nested(void *data) {
+	assert(!catch_error(fail, data));
+	*(int *)data += 1;
+	error("catch_error test: this error is expected");
+}
+
+void test_catch_error(void) {
+	int n = 0;
+	assert(catch_error(succeed, &n));
+	assert(n == 1);
+	assert(!catch_error(fail, &n));
+	assert(n == 2);
+	assert(!catch_error(nested, &n));
+	assert(n == 4);
+	assert(catch_error(succeed, &n));
+	assert(n == 5);
+}
+
 void util_test(void) {
 	test_dirname_utf8();
 	test_basename_utf8();
+	test_catch_error();
 }
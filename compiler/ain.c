@@ -16,6 +16,7 @@
  *
 */
 #include "xsys35c.h"
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -108,28 +109,38 @@ static void ain_emit_MSGI_head(Buffer *out, int msg_count) {
 	emit_dword(out, msg_count);
 }
 
-static void ain_write_buf(Buffer *buf, FILE *fp) {
-	uint8_t *end = buf->buf + buf->len;
-	for (uint8_t *p = buf->buf; p < end; p++)
-		fputc(*p >> 2 | *p << 6, fp);
-}
-
 void ain_write(Compiler *compiler, FILE *fp) {
+	const char *magic;
 	switch (config.ain_version) {
-	case 1: fputs("AINI", fp); break;
-	case 2: fputs("AIN2", fp); break;
+	case 1: magic = "AINI"; break;
+	case 2: magic = "AIN2"; break;
 	default:
 		error("unknown ain version: %d", config.ain_version);
 	}
-	fputdw(config.ain_version, fp);
 	Buffer *out = new_buf();
 	ain_emit_HEL0(out, compiler->dlls);
 	ain_emit_FUNC(out, compiler->functions);
 	if (!config.disable_ain_variable)
 		ain_emit_VARI(out, compiler->variables);
-	if (compiler->msg_count > 0)
+	int msg_len = 0;
+	if (compiler->msg_count > 0) {
 		ain_emit_MSGI_head(out, compiler->msg_count);
-	ain_write_buf(out, fp);
-	if (compiler->msg_count > 0)
-		ain_write_buf(compiler->msg_buf, fp);
+		msg_len = compiler->msg_buf->len;
+	}
+
+	// Encrypt everything into one buffer and write it at once. The header is
+	// not encrypted.
+	int size = 8 + out->len + msg_len;
+	uint8_t *ain = malloc(size);
+	if (!ain)
+		error("out of memory");
+	memcpy(ain, magic, 4);
+	ain[4] = config.ain_version;
+	ain[5] = ain[6] = ain[7] = 0;
+	ain_encrypt(ain + 8, out->buf, out->len);
+	if (msg_len)
+		ain_encrypt(ain + 8 + out->len, compiler->msg_buf->buf, msg_len);
+	if (fwrite(ain, size, 1, fp) != 1)
+		error("ain_write: %s", strerror(errno));
+	free(ain);
 }
@@ -0,0 +1,190 @@
+/* Copyright (C) 2026 <KichikuouChrome@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+*/
+
+// Build cache. The compiled form of a page (see object_save_page()) is stored
+// in <cache-dir>/<key>.cache, where <key> is a hash of everything compile()
+// depends on: the page source and the project_hash().
+//
+// Without a directory, the latest compiled form of each page is kept in
+// memory instead. This is used by the compile server (--serve), which builds
+// in a child process; cache_send() and cache_receive() pass the pages that
+// the child compiled back to the server.
+
+#include "xsys35c.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CACHE_MAGIC "XCAC"
+
+typedef struct {
+	uint64_t key;
+	Buffer *payload;
+	bool fresh;  // stored by cache_store() rather than cache_receive()
+} CacheEntry;
+
+typedef struct BuildCache {
+	const char *dir;  // NULL if the cache is in memory
+	uint64_t project_hash;
+	Vector *entries;  // CacheEntries indexed by page, for in-memory caches
+} BuildCache;
+
+BuildCache *new_build_cache(const char *dir) {
+	if (dir && make_dir(dir) != 0 && errno != EEXIST)
+		error("cannot create %s: %s", dir, strerror(errno));
+
+	BuildCache *cache = calloc(1, sizeof(BuildCache));
+	cache->dir = dir;
+	cache->entries = new_vec();
+	return cache;
+}
+
+// Must be called after preprocess_done(), before loading or storing pages.
+void cache_set_project(BuildCache *cache, Compiler *compiler) {
+	cache->project_hash = project_hash(compiler);
+}
+
+static uint64_t cache_key(BuildCache *cache, Compiler *compiler, int page) {
+	Sco *sco = &compiler->scos[page];
+	uint32_t nums[3] = { page, sco->msg_start, sco->msg_count };
+	uint64_t h = hash64(cache->project_hash, nums, sizeof(nums));
+	return hash64(h, sco->source, strlen(sco->source));
+}
+
+static char *cache_path(BuildCache *cache, uint64_t key) {
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.cache", (unsigned long long)key);
+	return path_join(cache->dir, name);
+}
+
+// Restores the compiled form of a page from the cache. Returns false if the
+// page is not in the cache (or the cache file is broken).
+bool cache_load(BuildCache *cache, Compiler *compiler, int page) {
+	uint64_t key = cache_key(cache, compiler, page);
+	if (!cache->dir) {
+		CacheEntry *e = page < cache->entries->len ? cache->entries->data[page] : NULL;
+		if (!e || e->key != key)
+			return false;
+		return object_load_page(compiler, page, e->payload->buf);
+	}
+	uint64_t file_key;
+	char *path = cache_path(cache, key);
+	const uint8_t *payload = read_object_file(path, CACHE_MAGIC, &file_key);
+	free(path);
+	bool ok = payload && file_key == key && object_load_page(compiler, page, payload);
+	free((void *)payload);
+	return ok;
+}
+
+static void put_entry(BuildCache *cache, int page, uint64_t key, Buffer *payload, bool fresh) {
+	CacheEntry *e = page < cache->entries->len ? cache->entries->data[page] : NULL;
+	if (!e) {
+		e = calloc(1, sizeof(CacheEntry));
+		vec_set(cache->entries, page, e);
+	} else {
+		free(e->payload->buf);
+		free(e->payload);
+	}
+	e->key = key;
+	e->payload = payload;
+	e->fresh = fresh;
+}
+
+// Saves the compiled form of a page, before compile_done() resolves its
+// references to other pages.
+void cache_store(BuildCache *cache, Compiler *compiler, int page) {
+	Buffer *payload = new_buf();
+	object_save_page(compiler, page, payload);
+	uint64_t key = cache_key(cache, compiler, page);
+	if (!cache->dir) {
+		put_entry(cache, page, key, payload, true);
+		return;
+	}
+
+	// write_object_file() replaces the file atomically, so concurrent builds
+	// sharing the cache directory never read a partially written entry.
+	char *path = cache_path(cache, key);
+	write_object_file(path, CACHE_MAGIC, key, payload);
+	free(path);
+}
+
+static bool write_all(int fd, const void *buf, size_t len) {
+	const uint8_t *p = buf;
+	while (len > 0) {
+		ssize_t n = write(fd, p, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+static bool read_all(int fd, void *buf, size_t len) {
+	uint8_t *p = buf;
+	while (len > 0) {
+		ssize_t n = read(fd, p, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+// Writes the pages stored by cache_store() in an in-memory cache to fd, as (page, key, payload size, payload) records.
+void cache_send(BuildCache *cache, int fd) {
+	for (int page = 0; page < cache->entries->len; page++) {
+		CacheEntry *e = cache->entries->data[page];
+		if (!e || !e->fresh)
+			continue;
+		uint8_t header[16];
+		memcpy(header, &(uint32_t){page}, 4);
+		memcpy(header + 4, &e->key, 8);
+		memcpy(header + 12, &(uint32_t){e->payload->len}, 4);
+		if (!write_all(fd, header, sizeof(header)) ||
+			!write_all(fd, e->payload->buf, e->payload->len))
+			error("cache_send: %s", strerror(errno));
+	}
+}
+
+// Reads the records written by cache_send() until EOF. An incomplete record
+// at the end is ignored.
+void cache_receive(BuildCache *cache, int fd) {
+	uint8_t header[16];
+	while (read_all(fd, header, sizeof(header))) {
+		uint32_t page, len;
+		uint64_t key;
+		memcpy(&page, header, 4);
+		memcpy(&key, header + 4, 8);
+		memcpy(&len, header + 12, 4);
+		Buffer *payload = new_buf();
+		if (!read_all(fd, emit_reserve(payload, len), len)) {
+			free(payload->buf);
+			free(payload);
+			break;
+		}
+		payload->len = len;
+		put_entry(cache, page, key, payload, false);
+	}
+}
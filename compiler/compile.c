@@ -21,33 +21,69 @@
 #include <stdlib.h>
 #include <string.h>
 
-static Compiler *compiler;
-static const char *menu_item_start;
-static bool compiling;
-static Vector *branch_end_stack;
+// Per-page compilation state. These are thread-local so that pages can be
+// compiled in parallel.
+static _Thread_local Compiler *compiler;
+static _Thread_local const char *menu_item_start;
+static _Thread_local bool compiling;
+static _Thread_local Vector *branch_end_stack;
+static _Thread_local Buffer *msg_buf;
+static _Thread_local int msg_count;
+static _Thread_local Vector *func_refs;
+static _Thread_local Vector *definitions;
+static _Thread_local Peephole *peephole;  // non-NULL if -O2 is given, until pragma address
+
+// Objects that outlive the page (definitions, function records, relocations)
+// are allocated from the page's arena. Labels and identifiers returned by the
+// lexer are allocated from the scratch arena, which is reset after each page.
+static _Thread_local Arena *page_arena;
+static _Thread_local Arena *scratch_arena;
+
+static Symbol *new_symbol(Arena *arena, SymbolType type, int value) {
+	Symbol *s = arena_alloc(arena, sizeof(Symbol));
+	s->type = type;
+	s->value = value;
+	return s;
+}
 
+// Pages may be preprocessed in parallel, so the first pass does not modify
+// the symbol tables directly. Instead, it records definitions for each page,
+// and preprocess_done() adds them to the symbol tables in the order of pages.
 typedef enum {
-	VARIABLE,
-	CONST,
-} SymbolType;
+	DEF_VARIABLE,
+	DEF_CONST,
+	DEF_FUNCTION,
+} DefinitionType;
 
 typedef struct {
-	SymbolType type;
-	int value;  // variable index or constant value
-} Symbol;
-
-static Symbol *new_symbol(SymbolType type, int value) {
-	Symbol *s = calloc(1, sizeof(Symbol));
-	s->type = type;
-	s->value = value;
-	return s;
+	DefinitionType type;
+	const char *name;
+	const char *source_loc;
+	int value;  // for DEF_CONST
+	Function *func;  // for DEF_FUNCTION
+} Definition;
+
+static Definition *add_definition(DefinitionType type, const char *name, const char *source_loc) {
+	Definition *def = arena_alloc(page_arena, sizeof(Definition));
+	def->type = type;
+	def->name = arena_strdup(page_arena, name);
+	def->source_loc = source_loc;
+	vec_push(definitions, def);
+	return def;
 }
 
-static Map *labels;
+static _Thread_local HashMap *labels;
+static _Thread_local Vector *label_list;  // labels in order of appearance
 
-static Buffer *out;
+static _Thread_local Buffer *out;
 
 static int lookup_var(char *var, bool create) {
+	if (!compiling) {
+		if (create)
+			add_definition(DEF_VARIABLE, var, input - strlen(var));
+		return -1;
+	}
+
 	Symbol *sym = hash_get(compiler->symbols, var);
 	if (sym) {
 		switch (sym->type) {
@@ -59,17 +95,11 @@ static int lookup_var(char *var, bool create) {
 			return -1;
 		}
 	}
-
-	if (!create)
-		return -1;
-	sym = new_symbol(VARIABLE, compiler->variables->len);
-	vec_push(compiler->variables, var);
-	hash_put(compiler->symbols, var, sym);
-	return sym->value;
+	return -1;
 }
 
-static void expr(void);
-static void expr_equal(void);
+static int expr(void);
+static int expr_equal(void);
 static void commands(void);
 
 static void variable(char *id, bool create) {
@@ -87,99 +117,172 @@ static void variable(char *id, bool create) {
 	}
 }
 
-static void number(void) {
-	emit_number(out, get_number());
+#define NOT_CONST -1
+
+// Emits the number n. Returns n if the engine evaluates it exactly, i.e. it
+// fits in 16 bits (larger numbers are split into a sum by emit_number()).
+static int constant(int n) {
+	emit_number(out, n);
+	return n <= 0xffff ? n : NOT_CONST;
+}
+
+static int number(void) {
+	return constant(get_number());
+}
+
+// Discards the code emitted at or after addr, and the references to it
+// recorded for relocation.
+static void truncate_code(int addr) {
+	out->len = addr;
+	Vector *msg_refs = compiler->scos[input_page].msg_refs;
+	while (msg_refs->len > 0 && stack_top(msg_refs) >= addr)
+		stack_pop(msg_refs);
+	while (func_refs->len > 0 && ((FuncRef *)func_refs->data[func_refs->len - 1])->addr >= addr)
+		func_refs->len--;
+	if (peephole)
+		peephole_truncate(peephole, addr);
+	if (compiler->dbg_info)
+		debug_line_truncate(compiler->dbg_info, input_page, addr);
+}
+
+// Called after the operator op (OP_* or OP_C0_*) is emitted for the operands
+// lhs and rhs, whose code starts at start. With -O, if both operands are
+// constants, the code is replaced by the result and it is returned. Results
+// that do not fit in 16 bits, and division by zero, are left to the engine.
+static int fold(int start, int op, int lhs, int rhs) {
+	if (!config.optimize || !out || lhs == NOT_CONST || rhs == NOT_CONST)
+		return NOT_CONST;
+	int64_t v;
+	switch (op) {
+	case OP_AND: v = lhs & rhs; break;
+	case OP_OR: v = lhs | rhs; break;
+	case OP_XOR: v = lhs ^ rhs; break;
+	case OP_MUL: v = (int64_t)lhs * rhs; break;
+	case OP_ADD: v = lhs + rhs; break;
+	case OP_SUB: v = lhs - rhs; break;
+	case OP_EQ: v = lhs == rhs; break;
+	case OP_LT: v = lhs < rhs; break;
+	case OP_GT: v = lhs > rhs; break;
+	case OP_NE: v = lhs != rhs; break;
+	case OP_C0_LE: v = lhs <= rhs; break;
+	case OP_C0_GE: v = lhs >= rhs; break;
+	case OP_DIV:
+	case OP_C0_MOD:
+		if (!rhs)
+			return NOT_CONST;
+		v = op == OP_DIV ? lhs / rhs : lhs % rhs;
+		break;
+	default:
+		return NOT_CONST;
+	}
+	if (v < 0 || v > 0xffff)
+		return NOT_CONST;
+	truncate_code(start);
+	emit_number(out, v);
+	return v;
 }
 
+// The expr_* functions return the value of the expression if it is a
+// constant, or NOT_CONST.
+
 // prim ::= '(' equal ')' | number | '#' filename | const | var
-static void expr_prim(void) {
+static int expr_prim(void) {
 	if (consume('(')) {
-		expr_equal();
+		int val = expr_equal();
 		expect(')');
+		return val;
 	} else if (isdigit(next_char())) {
-		number();
+		return number();
 	} else if (consume('#')) {
 		const char *top = input;
 		char *fname = get_filename();
 		for (int i = 0; i < compiler->src_paths->len; i++) {
-			if (!strcasecmp(fname, basename_utf8(compiler->src_paths->data[i]))) {
-				emit_number(out, i);
-				return;
-			}
+			if (!strcasecmp(fname, basename_utf8(compiler->src_paths->data[i])))
+				return constant(i);
 		}
 		error_at(top, "reference to unknown source file: '%s'", fname);
 	} else {
 		char *id = get_identifier();
-		if (!strcmp(id, "__LINE__")) {
-			emit_number(out, input_line);
-		} else {
-			Symbol *sym = hash_get(compiler->symbols, id);
-			if (sym && sym->type == CONST)
-				emit_number(out, sym->value);
-			else
-				variable(id, false);
-		}
+		if (!strcmp(id, "__LINE__"))
+			return constant(input_line);
+		Symbol *sym = hash_get(compiler->symbols, id);
+		if (sym && sym->type == CONST)
+			return constant(sym->value);
+		variable(id, false);
+		return NOT_CONST;
 	}
 }
 
 // mul ::= prim ('*' prim | '/' prim | '%' prim)*
-static void expr_mul(void) {
-	expr_prim();
+static int expr_mul(void) {
+	int start = current_address(out);
+	int val = expr_prim();
 	for (;;) {
 		if (consume('*')) {
-			expr_prim();
+			int rhs = expr_prim();
 			emit(out, OP_MUL);
+			val = fold(start, OP_MUL, val, rhs);
 		} else if (consume('/')) {
-			expr_prim();
+			int rhs = expr_prim();
 			emit(out, OP_DIV);
+			val = fold(start, OP_DIV, val, rhs);
 		} else if (consume('%')) {
-			expr_prim();
+			int rhs = expr_prim();
 			emit(out, 0xc0);
 			emit(out, OP_C0_MOD);
+			val = fold(start, OP_C0_MOD, val, rhs);
 		} else {
-			break;
+			return val;
 		}
 	}
 }
 
 // add ::= mul ('+' mul | '-' mul)*
-static void expr_add(void) {
-	expr_mul();
+static int expr_add(void) {
+	int start = current_address(out);
+	int val = expr_mul();
 	for (;;) {
 		if (consume('+')) {
-			expr_mul();
+			int rhs = expr_mul();
 			emit(out, OP_ADD);
+			val = fold(start, OP_ADD, val, rhs);
 		} else if (consume('-')) {
-			expr_mul();
+			int rhs = expr_mul();
 			emit(out, OP_SUB);
+			val = fold(start, OP_SUB, val, rhs);
 		} else {
-			break;
+			return val;
 		}
 	}
 }
 
 // bit ::= add ('&' add | '|' add | '^' add)*
-static void expr_bit(void) {
-	expr_add();
+static int expr_bit(void) {
+	int start = current_address(out);
+	int val = expr_add();
 	for (;;) {
 		if (consume('&')) {
-			expr_add();
+			int rhs = expr_add();
 			emit(out, OP_AND);
+			val = fold(start, OP_AND, val, rhs);
 		} else if (consume('|')) {
-			expr_add();
+			int rhs = expr_add();
 			emit(out, OP_OR);
+			val = fold(start, OP_OR, val, rhs);
 		} else if (consume('^')) {
-			expr_add();
+			int rhs = expr_add();
 			emit(out, OP_XOR);
+			val = fold(start, OP_XOR, val, rhs);
 		} else {
-			break;
+			return val;
 		}
 	}
 }
 
 // compare ::= bit ('<' bit | '>' bit | '<=' bit | '>=' bit)*
-static void expr_compare(void) {
-	expr_bit();
+static int expr_compare(void) {
+	int start = current_address(out);
+	int val = expr_bit();
 	for (;;) {
 		int op = 0;
 		if (consume('<')) {
@@ -192,36 +295,54 @@ static void expr_compare(void) {
 				op = OP_C0_GE;
 		}
 		if (!op)
-			break;
-		expr_bit();
+			return val;
+		int rhs = expr_bit();
 		if (op == OP_C0_LE || op == OP_C0_GE)
 			emit(out, 0xc0);
 		emit(out, op);
+		val = fold(start, op, val, rhs);
 	}
 }
 
 // equal ::= compare ('=' compare | '\' compare | '$' compare)*
-static void expr_equal(void) {
-	expr_compare();
+static int expr_equal(void) {
+	int start = current_address(out);
+	int val = expr_compare();
 	for (;;) {
 		if (consume('=')) {
-			expr_compare();
+			int rhs = expr_compare();
 			emit(out, OP_EQ);
+			val = fold(start, OP_EQ, val, rhs);
 		} else if (consume('\\')) {
-			expr_compare();
+			int rhs = expr_compare();
 			emit(out, OP_NE);
+			val = fold(start, OP_NE, val, rhs);
 		} else if (consume('$')) {
 			expr_compare();
+			val = NOT_CONST;
 		} else {
-			break;
+			return val;
 		}
 	}
 }
 
 // expr ::= equal
-static void expr(void) {
-	expr_equal();
+static int expr(void) {
+	int val = expr_equal();
 	emit(out, OP_END);
+	return val;
+}
+
+// Records the destination of a page jump or call, for --strip-dead. page is
+// NOT_CONST if it is not known at compile time.
+static void page_ref(int page) {
+	if (!compiling)
+		return;
+	Sco *sco = &compiler->scos[input_page];
+	if (page == NOT_CONST)
+		sco->dynamic_page_refs = true;
+	else
+		stack_push(sco->page_refs, page);
 }
 
 // 'const' 'word' identifier '=' constexpr (',' identifier '=' constexpr)* ':'
@@ -233,28 +354,20 @@ static void define_const(void) {
 		char *id = get_identifier();
 		consume('=');
 		int val = get_number();  // TODO: Allow expressions
-		if (!compiling) {
-			Symbol *sym = hash_get(compiler->symbols, id);
-			if (sym) {
-				switch (sym->type) {
-				case VARIABLE:
-					error_at(top, "'%s' is already defined as a variable", id);
-				case CONST:
-					error_at(top, "constant '%s' redefined", id);
-				}
-			}
-			hash_put(compiler->symbols, id, new_symbol(CONST, val));
-		}
+		if (!compiling)
+			add_definition(DEF_CONST, id, top)->value = val;
 	} while (consume(','));
 	expect(':');
 }
 
 static Label *lookup_label(char *id) {
-	Label *l = map_get(labels, id);
+	Label *l = hash_get(labels, id);
 	if (!l) {
-		l = calloc(1, sizeof(Label));
+		l = arena_alloc(scratch_arena, sizeof(Label));
+		l->name = id;
 		l->source_loc = input - strlen(id);
-		map_put(labels, id, l);
+		hash_put(labels, id, l);
+		vec_push(label_list, l);
 	}
 	return l;
 }
@@ -272,10 +385,14 @@ static void add_label(void) {
 		l->hole_addr = swap_dword(out, l->hole_addr, l->addr);
 }
 
-static Label *label(void) {
+// Emits the address of a label. is_branch tells the peephole optimizer whether
+// the address is a jump destination.
+static Label *label(bool is_branch) {
 	char *id = get_label();
 	if (!compiling)
 		return NULL;
+	if (peephole)
+		peephole_addr(peephole, current_address(out), is_branch);
 	Label *l = lookup_label(id);
 	if (!l->addr) {
 		emit_dword(out, l->hole_addr);
@@ -287,6 +404,31 @@ static Label *label(void) {
 	return l;
 }
 
+// Emits the (page, address) pair of a function. Functions in other pages may
+// not be compiled yet (or may be being compiled by another thread), so
+// references to them are recorded and patched later by compile_done().
+// References to functions in this page are recorded too, for --strip-dead.
+static void function_address(Function *func) {
+	FuncRef *ref = arena_alloc(page_arena, sizeof(FuncRef));
+	ref->addr = current_address(out);
+	ref->func = func;
+	vec_push(func_refs, ref);
+	emit_word(out, 0);
+	emit_dword(out, 0);
+}
+
+// Tells the peephole optimizer about a '!' instruction at op that assigns the
+// variable at [op + 1, var_end) to itself.
+static void check_self_assignment(int op, int var_end) {
+	if (!peephole || get_byte(out, op) != '!')
+		return;
+	int var_len = var_end - op - 1;
+	int end = current_address(out);
+	if (end - var_end == var_len + 1 && get_byte(out, end - 1) == OP_END &&
+		!memcmp(out->buf + op + 1, out->buf + var_end, var_len))
+		peephole_nop(peephole, op, end);
+}
+
 // defun ::= '**' name (var (',' var)*)? ':'
 static void defun(void) {
 	const char *top = input;
@@ -294,10 +436,8 @@ static void defun(void) {
 
 	if (!compiling) {
 		// First pass - create a function record and store parameter info
-		if (hash_get(compiler->functions, name))
-			error_at(top, "function '%s' redefined", name);
-		Function *func = calloc(1, sizeof(Function));
-		func->name = name;
+		Function *func = arena_alloc(page_arena, sizeof(Function));
+		func->page = input_page + 1;
 		func->params = new_vec();
 
 		bool needs_comma = false;
@@ -305,39 +445,20 @@ static void defun(void) {
 			if (needs_comma)
 				expect(',');
 			needs_comma = true;
-			vec_push(func->params, get_identifier());
+			vec_push(func->params, arena_strdup(page_arena, get_identifier()));
 		}
-		hash_put(compiler->functions, name, func);
+		Definition *def = add_definition(DEF_FUNCTION, name, top);
+		def->func = func;
+		func->name = def->name;
 		return;
 	}
 
 	// Second pass - resolve function address
 	Function *func = hash_get(compiler->functions, name);
 	assert(func);
+	assert(func->page == input_page + 1);
 	assert(!func->resolved);
-
-	const int page = input_page + 1;
-	const uint32_t addr = current_address(out);
-	while (func->addr) {
-		if (func->page == page) {
-			func->page = swap_word(out, func->addr, page);
-			func->addr = swap_dword(out, func->addr + 2, addr);
-		} else {
-			Buffer *sco = compiler->scos[func->page - 1].buf;
-			assert(sco);
-			uint8_t *p = sco->buf + func->addr;
-			func->page = p[0] | p[1] << 8;
-			func->addr = p[2] | p[3] << 8 | p[4] << 16 | p[5] << 24;
-			p[0] = page & 0xff;
-			p[1] = page >> 8;
-			p[2] = addr & 0xff;
-			p[3] = addr >> 8 & 0xff;
-			p[4] = addr >> 16 & 0xff;
-			p[5] = addr >> 24 & 0xff;
-		}
-	}
-	func->page = page;
-	func->addr = addr;
+	func->addr = current_address(out);
 	func->resolved = true;
 
 	// Check if all parameters are defined as variables.
@@ -390,24 +511,22 @@ static void funcall(void) {
 	if (!func)
 		error_at(top, "undefined function '%s'", name);
 	for (int i = 0; i < func->params->len; i++) {
+		int op = current_address(out);
 		emit(out, '!');
 		int var = lookup_var(func->params->data[i], false);
 		emit_var(out, var);
+		int var_end = current_address(out);
 		if (i == 0)
 			consume(',');
 		else
 			expect(',');
 		expr();
+		check_self_assignment(op, var_end);
 	}
 	expect(':');
 
 	emit(out, '~');
-	emit_word(out, func->page);
-	emit_dword(out, func->addr);
-	if (!func->resolved) {
-		func->page = input_page + 1;
-		func->addr = current_address(out) - 6;
-	}
+	function_address(func);
 }
 
 // numarray ::= '[' ']' | '[' number (',' number)* ']'
@@ -484,7 +603,7 @@ static int hel_index(const char *dllname) {
 static void dll_call(void) {
 	const char *dot = strchr(input, '.');
 	assert(dot);
-	const char *dllname = strndup_(input, dot - input);
+	const char *dllname = arena_strndup(scratch_arena, input, dot - input);
 	int dll_index = hel_index(dllname);
 	if (dll_index < 0)
 		error_at(input, "unknown DLL name '%s'", dllname);
@@ -562,12 +681,7 @@ static void arguments(const char *sig) {
 					Function *func = hash_get(compiler->functions, name);
 					if (!func)
 						error_at(top, "undefined function '%s'", name);
-					emit_word(out, func->page);
-					emit_dword(out, func->addr);
-					if (!func->resolved) {
-						func->page = input_page + 1;
-						func->addr = current_address(out) - 6;
-					}
+					function_address(func);
 				}
 			}
 			break;
@@ -590,6 +704,7 @@ static void assign(void) {
 	int op = current_address(out);
 	emit(out, '!');
 	variable(get_identifier(), true);
+	int var_end = current_address(out);
 	if (consume('+')) {
 		set_byte(out, op, 0x10);
 	} else if (consume('-')) {
@@ -610,15 +725,21 @@ static void assign(void) {
 	expect(':');
 	expr();
 	expect('!');
+	check_self_assignment(op, var_end);
 }
 
 // conditional ::= '{' expr ':' commands '}'
 static void conditional(void) {
+	int op = current_address(out);
 	emit(out, '{');
 	expr();
 	expect(':');
 	int hole = current_address(out);
 	emit_dword(out, 0);
+	if (peephole) {
+		peephole_cond(peephole, op, hole + 4);
+		peephole_addr(peephole, hole, true);
+	}
 
 	if (branch_end_stack) {
 		stack_push(branch_end_stack, hole);
@@ -628,6 +749,10 @@ static void conditional(void) {
 	commands();
 	expect('}');
 	if (config.sys_ver >= SYSTEM38 && !config.disable_else) {
+		if (peephole) {
+			peephole_jump(peephole, current_address(out));
+			peephole_addr(peephole, current_address(out) + 1, true);
+		}
 		emit(out, '@'); // Label jump
 		emit_dword(out, 0);
 		swap_dword(out, hole, current_address(out));
@@ -659,6 +784,10 @@ static void while_loop(void) {
 
 	expect('>');
 	emit(out, '>');
+	if (peephole) {
+		peephole_addr(peephole, end_hole, true);
+		peephole_addr(peephole, current_address(out), true);
+	}
 	emit_dword(out, loop_addr);
 
 	swap_dword(out, end_hole, current_address(out));
@@ -700,6 +829,10 @@ static void for_loop(void) {
 
 	expect('>');
 	emit(out, '>');
+	if (peephole) {
+		peephole_addr(peephole, end_hole, true);
+		peephole_addr(peephole, current_address(out), true);
+	}
 	emit_dword(out, loop_addr);
 
 	swap_dword(out, end_hole, current_address(out));
@@ -711,16 +844,22 @@ static void pragma(void) {
 		expect(':');
 	} else if (consume_keyword("address")) {
 		int address = get_number();
+		// The code after the pragma is pinned to the address, so the page
+		// must not be rearranged by the peephole optimizer.
+		if (peephole) {
+			free_peephole(peephole);
+			peephole = NULL;
+		}
 		if (out) {
 			if (out->len > address)
-				out->len = address;
+				truncate_code(address);
 			while (out->len < address)
 				emit(out, 0);
 			// Addresses in LINE debug table must be monotonically increasing,
 			// but address pragma breaks this condition. So clear the LINE info
 			// for this page.
 			if (compiler->dbg_info)
-				debug_line_reset(compiler->dbg_info);
+				debug_line_reset(compiler->dbg_info, input_page);
 		}
 		expect(':');
 	} else {
@@ -728,6 +867,14 @@ static void pragma(void) {
 	}
 }
 
+// Emits the ID of the last message added to msg_buf. The address is recorded
+// so that compile_done() can renumber the messages for --dedup-messages.
+static void message_id(void) {
+	if (compiling)
+		stack_push(compiler->scos[input_page].msg_refs, current_address(out));
+	emit_dword(out, msg_count++);
+}
+
 static int subcommand_num(void) {
 	int n = get_number();
 	emit(out, n);
@@ -738,7 +885,7 @@ static int subcommand_num(void) {
 static bool command(void) {
 	skip_whitespaces();
 	if (out && compiler->dbg_info)
-		debug_line_add(compiler->dbg_info, input_line, current_address(out));
+		debug_line_add(compiler->dbg_info, input_page, input_line, current_address(out));
 
 	const char *command_top = input;
 	int cmd = get_command(out);
@@ -755,8 +902,8 @@ static bool command(void) {
 		case SYSTEM39:
 			if (use_ain_message()) {
 				emit_command(out, COMMAND_ainMsg);
-				compile_message(compiler->msg_buf);
-				emit_dword(out, compiler->msg_count++);
+				compile_message(msg_buf);
+				message_id();
 				break;
 			}
 			// fall through
@@ -798,8 +945,10 @@ static bool command(void) {
 		break;
 
 	case '@':  // Label jump
+		if (peephole)
+			peephole_jump(peephole, current_address(out));
 		emit(out, cmd);
-		label();
+		label(true);
 		expect(':');
 		break;
 
@@ -808,7 +957,7 @@ static bool command(void) {
 		if (consume('0'))
 			emit_dword(out, 0);  // Return
 		else {
-			Label *l = label();
+			Label *l = label(true);
 			if (l)
 				l->is_function = true;
 		}
@@ -817,13 +966,13 @@ static bool command(void) {
 
 	case '&':  // Page jump
 		emit(out, cmd);
-		expr();
+		page_ref(expr());
 		expect(':');
 		break;
 
 	case '%':  // Page call / return
 		emit(out, cmd);
-		expr();
+		page_ref(expr());
 		expect(':');
 		break;
 
@@ -849,7 +998,7 @@ static bool command(void) {
 			menu_item_start = NULL;
 			break;
 		}
-		label();
+		label(true);
 		expect('$');
 		if (!isascii(*input)) {
 			compile_string(out, '$', config.sys_ver == SYSTEM35, true);
@@ -861,14 +1010,14 @@ static bool command(void) {
 
 	case '#':  // Data table address
 		emit(out, cmd);
-		label();
+		label(false);
 		expect(',');
 		expr();
 		expect(':');
 		break;
 
 	case '_':  // Label address as data
-		label();
+		label(false);
 		expect(':');
 		break;
 
@@ -1229,49 +1378,6 @@ static bool command(void) {
 		pragma();
 		break;
 
-	case COMMAND_TOC: arguments(""); break;
-	case COMMAND_TOS: arguments(""); break;
-	case COMMAND_TPC: arguments("e"); break;
-	case COMMAND_TPS: arguments("e"); break;
-	case COMMAND_TOP: arguments(""); break;
-	case COMMAND_TPP: arguments(""); break;
-	case COMMAND_inc: arguments("v"); break;
-	case COMMAND_dec: arguments("v"); break;
-	case COMMAND_TAA: arguments("e"); break;
-	case COMMAND_TAB: arguments("v"); break;
-	case COMMAND_wavLoad: arguments("ee"); break;
-	case COMMAND_wavPlay: arguments("ee"); break;
-	case COMMAND_wavStop: arguments("e"); break;
-	case COMMAND_wavUnload: arguments("e"); break;
-	case COMMAND_wavIsPlay: arguments("ev"); break;
-	case COMMAND_wavFade: arguments("eeee"); break;
-	case COMMAND_wavIsFade: arguments("ev"); break;
-	case COMMAND_wavStopFade: arguments("e"); break;
-	case COMMAND_trace: arguments("z"); break;
-	case COMMAND_wav3DSetPos: arguments("eeee"); break;
-	case COMMAND_wav3DCommit: arguments(""); break;
-	case COMMAND_wav3DGetPos: arguments("evvv"); break;
-	case COMMAND_wav3DSetPosL: arguments("eee"); break;
-	case COMMAND_wav3DGetPosL: arguments("vvv"); break;
-	case COMMAND_wav3DFadePos: arguments("eeeee"); break;
-	case COMMAND_wav3DIsFadePos: arguments("ev"); break;
-	case COMMAND_wav3DStopFadePos: arguments("e"); break;
-	case COMMAND_wav3DFadePosL: arguments("eeee"); break;
-	case COMMAND_wav3DIsFadePosL: arguments("v"); break;
-	case COMMAND_wav3DStopFadePosL: arguments(""); break;
-	case COMMAND_sndPlay: arguments("ee"); break;
-	case COMMAND_sndStop: arguments(""); break;
-	case COMMAND_sndIsPlay: arguments("v"); break;
-	case COMMAND_msg: arguments("z"); break;
-	case COMMAND_newHH: arguments("ne"); break;
-	case COMMAND_newLC: arguments("eez"); break;
-	case COMMAND_newLE: arguments("nzee"); break;
-	case COMMAND_newLXG: arguments("ezz"); break;
-	case COMMAND_newMI: arguments("eez"); break;
-	case COMMAND_newMS: arguments("ez"); break;
-	case COMMAND_newMT: arguments("z"); break;
-	case COMMAND_newNT: arguments("z"); break;
-	case COMMAND_newQE: arguments("nzee"); break;
 	case COMMAND_newUP:
 		switch (subcommand_num()) {
 		case 0:
@@ -1285,112 +1391,29 @@ static bool command(void) {
 			goto unknown_command;
 		}
 		break;
-	case COMMAND_newF: arguments("nee"); break;
-	case COMMAND_wavWaitTime: arguments("ee"); break;
-	case COMMAND_wavGetPlayPos: arguments("ev"); break;
-	case COMMAND_wavWaitEnd: arguments("e"); break;
-	case COMMAND_wavGetWaveTime: arguments("ev"); break;
-	case COMMAND_menuSetCbkSelect: arguments("F"); break;
-	case COMMAND_menuSetCbkCancel: arguments("F"); break;
-	case COMMAND_menuClearCbkSelect: arguments(""); break;
-	case COMMAND_menuClearCbkCancel: arguments(""); break;
-	case COMMAND_wav3DSetMode: arguments("ee"); break;
-	case COMMAND_grCopyStretch: arguments("eeeeeeeee"); break;
-	case COMMAND_grFilterRect: arguments("eeeee"); break;
-	case COMMAND_iptClearWheelCount: arguments(""); break;
-	case COMMAND_iptGetWheelCount: arguments("vv"); break;
-	case COMMAND_menuGetFontSize: arguments("v"); break;
-	case COMMAND_msgGetFontSize: arguments("v"); break;
-	case COMMAND_strGetCharType: arguments("eev"); break;
-	case COMMAND_strGetLengthASCII: arguments("ev"); break;
-	case COMMAND_sysWinMsgLock: arguments(""); break;
-	case COMMAND_sysWinMsgUnlock: arguments(""); break;
-	case COMMAND_aryCmpCount: arguments("veev"); break;
-	case COMMAND_aryCmpTrans: arguments("veeeev"); break;
-	case COMMAND_grBlendColorRect: arguments("eeeeeeeee"); break;
-	case COMMAND_grDrawFillCircle: arguments("eeee"); break;
-	case COMMAND_MHH: arguments("eee"); break;
-	case COMMAND_menuSetCbkInit: arguments("F"); break;
-	case COMMAND_menuClearCbkInit: arguments(""); break;
-	case COMMAND_sysOpenShell: arguments("z"); break;
-	case COMMAND_sysAddWebMenu: arguments("zz"); break;
-	case COMMAND_iptSetMoveCursorTime: arguments("e"); break;
-	case COMMAND_iptGetMoveCursorTime: arguments("v"); break;
-	case COMMAND_grBlt: arguments("eeeeee"); break;
-	case COMMAND_LXWT: arguments("ez"); break;
-	case COMMAND_LXWS: arguments("ee"); break;
-	case COMMAND_LXWE: arguments("ee"); break;
-	case COMMAND_LXWH: arguments("ene"); break;
-	case COMMAND_LXWHH: arguments("ene"); break;
-	case COMMAND_sysGetOSName: arguments("e"); break;
-	case COMMAND_patchEC: arguments("e"); break;
-	case COMMAND_mathSetClipWindow: arguments("eeee"); break;
-	case COMMAND_mathClip: arguments("vvvvvv"); break;
-	case COMMAND_LXF: arguments("ezz"); break;
-	case COMMAND_strInputDlg: arguments("zeev"); break;
-	case COMMAND_strCheckASCII: arguments("ev"); break;
-	case COMMAND_strCheckSJIS: arguments("ev"); break;
-	case COMMAND_strMessageBox: arguments("z"); break;
-	case COMMAND_strMessageBoxStr: arguments("e"); break;
-	case COMMAND_grCopyUseAMapUseA: arguments("eeeeeee"); break;
-	case COMMAND_grSetCEParam: arguments("ee"); break;
-	case COMMAND_grEffectMoveView: arguments("eeee"); break;
-	case COMMAND_cgSetCacheSize: arguments("e"); break;
 	case COMMAND_dllCall: dll_call(); break;
-	case COMMAND_gaijiSet: arguments("ee"); break;
-	case COMMAND_gaijiClearAll: arguments(""); break;
-	case COMMAND_menuGetLatestSelect: arguments("v"); break;
-	case COMMAND_lnkIsLink: arguments("eev"); break;
-	case COMMAND_lnkIsData: arguments("eev"); break;
-	case COMMAND_fncSetTable: arguments("eF"); break;
-	case COMMAND_fncSetTableFromStr: arguments("eev"); break;
-	case COMMAND_fncClearTable: arguments("e"); break;
-	case COMMAND_fncCall: arguments("e"); break;
-	case COMMAND_fncSetReturnCode: arguments("e"); break;
-	case COMMAND_fncGetReturnCode: arguments("v"); break;
-	case COMMAND_msgSetOutputFlag: arguments("e"); break;
-	case COMMAND_saveDeleteFile: arguments("ev"); break;
-	case COMMAND_wav3DSetUseFlag: arguments("e"); break;
-	case COMMAND_wavFadeVolume: arguments("eeee"); break;
-	case COMMAND_patchEMEN: arguments("e"); break;
-	case COMMAND_wmenuEnableMsgSkip: arguments("e"); break;
-	case COMMAND_winGetFlipFlag: arguments("v"); break;
-	case COMMAND_cdGetMaxTrack: arguments("v"); break;
-	case COMMAND_dlgErrorOkCancel: arguments("zv"); break;
-	case COMMAND_menuReduce: arguments("e"); break;
-	case COMMAND_menuGetNumof: arguments("v"); break;
-	case COMMAND_menuGetText: arguments("ee"); break;
-	case COMMAND_menuGoto: arguments("ee"); break;
-	case COMMAND_menuReturnGoto: arguments("ee"); break;
-	case COMMAND_menuFreeShelterDIB: arguments(""); break;
-	case COMMAND_msgFreeShelterDIB: arguments(""); break;
 	case COMMAND_ainH: // fall through
 	case COMMAND_ainHH:
-		emit(compiler->msg_buf, 0);
-		emit_dword(out, compiler->msg_count++);
+		emit(msg_buf, 0);
+		message_id();
 		arguments("ne");
 		break;
 	case COMMAND_ainX:
-		emit(compiler->msg_buf, 0);
-		emit_dword(out, compiler->msg_count++);
+		emit(msg_buf, 0);
+		message_id();
 		arguments("e");
 		break;
-	case COMMAND_dataSetPointer: arguments("F"); break;
-	case COMMAND_dataGetWORD: arguments("ve"); break;
-	case COMMAND_dataGetString: arguments("ee"); break;
-	case COMMAND_dataSkipWORD: arguments("e"); break;
-	case COMMAND_dataSkipString: arguments("e"); break;
-	case COMMAND_varGetNumof: arguments("v"); break;
-	case COMMAND_patchG0: arguments("e"); break;
-	case COMMAND_regReadString: arguments("eeev"); break;
-	case COMMAND_fileCheckExist: arguments("ev"); break;
-	case COMMAND_timeCheckCurDate: arguments("eeev"); break;
-	case COMMAND_dlgManualProtect: arguments("oo"); break;
-	case COMMAND_fileCheckDVD: arguments("oeeov"); break;
-	case COMMAND_sysReset: arguments(""); break;
 
 	default:
-		goto unknown_command;
+		{
+			const CommandInfo *info = command_info(cmd);
+			if (!info || !info->args)
+				goto unknown_command;
+			if (cmd == COMMAND_fncSetTableFromStr)
+				page_ref(NOT_CONST);  // looks up a function by name
+			arguments(info->args);
+		}
+		break;
 	}
 	return true;
  unknown_command:
@@ -1409,7 +1432,7 @@ static void toplevel(void) {
 		// Inject "ZU 1:" command.
 		skip_whitespaces();
 		if (out && compiler->dbg_info)
-			debug_line_add(compiler->dbg_info, input_line, current_address(out));
+			debug_line_add(compiler->dbg_info, input_page, input_line, current_address(out));
 		emit(out, 'Z');
 		emit(out, 'U');
 		emit(out, 0x41);
@@ -1421,33 +1444,85 @@ static void toplevel(void) {
 		error_at(input, "unexpected '%c'", *input);
 }
 
+static const char *intern_name(Compiler *comp, const char *name) {
+	return intern(comp->names, name, strlen(name));
+}
+
 Compiler *new_compiler(Vector *src_paths, Vector *variables, Map *dlls) {
 	Compiler *comp = calloc(1, sizeof(Compiler));
 	comp->src_paths = src_paths;
 	comp->variables = variables ? variables : new_vec();
-	comp->symbols = new_string_hash();
-	comp->functions = new_string_hash();
+	comp->names = new_interner();
+	comp->symbols = new_hashed_string_hash();
+	comp->functions = new_hashed_string_hash();
 	comp->dlls = dlls ? dlls : new_map();
 	comp->scos = calloc(src_paths->len, sizeof(Sco));
+	comp->arena = new_arena();
+	for (int i = 0; i < src_paths->len; i++)
+		comp->scos[i].arena = new_arena();
 
 	for (int i = 0; i < comp->variables->len; i++)
-		hash_put(comp->symbols, comp->variables->data[i], new_symbol(VARIABLE, i));
+		hash_put(comp->symbols, intern_name(comp, comp->variables->data[i]), new_symbol(comp->arena, VARIABLE, i));
 
 	return comp;
 }
 
+// Frees a Compiler that has not been through compile(), such as the one kept
+// by the compile server. src_paths, variables and dlls belong to the caller.
+void free_compiler(Compiler *comp) {
+	for (int i = 0; i < comp->src_paths->len; i++) {
+		reset_page(comp, i);
+		free_arena(comp->scos[i].arena);
+	}
+	free_hash(comp->symbols);
+	free_hash(comp->functions);
+	free_interner(comp->names);
+	free_arena(comp->arena);
+	free(comp->scos);
+	free(comp);
+}
+
+// Discards the result of preprocess() for a page, so that it can be
+// preprocessed again.
+void reset_page(Compiler *comp, int pageno) {
+	Sco *sco = &comp->scos[pageno];
+	for (int i = 0; sco->definitions && i < sco->definitions->len; i++) {
+		Definition *def = sco->definitions->data[i];
+		if (def->type == DEF_FUNCTION && def->func)
+			free_vec(def->func->params);
+	}
+	arena_reset(sco->arena);
+	free_vec(sco->definitions);
+	sco->source = NULL;
+	sco->definitions = NULL;
+}
+
+// Frees the scratch arena of the calling thread. A thread that stops
+// compiling must call this, as must a thread whose preprocess() or compile()
+// failed, which leaves the arena in use.
+void free_scratch_arena(void) {
+	if (scratch_arena)
+		free_arena(scratch_arena);
+	scratch_arena = NULL;
+}
+
 static void prepare(Compiler *comp, const char *source, int pageno) {
 	compiler = comp;
+	page_arena = comp->scos[pageno].arena;
+	if (!scratch_arena)
+		scratch_arena = new_arena();
 	lexer_init(source, comp->src_paths->data[pageno], pageno);
+	lexer_arena = scratch_arena;
+	lexer_names = comp->names;
 	menu_item_start = NULL;
 	branch_end_stack = (config.sys_ver == SYSTEM35) ? new_vec() : NULL;
 }
 
 static void check_undefined_labels(void) {
-	for (int i = 0; i < labels->vals->len; i++) {
-		Label *l = labels->vals->data[i];
+	for (int i = 0; i < label_list->len; i++) {
+		Label *l = label_list->data[i];
 		if (l->hole_addr)
-			error_at(l->source_loc, "undefined label '%s'", labels->keys->data[i]);
+			error_at(l->source_loc, "undefined label '%s'", l->name);
 	}
 }
 
@@ -1455,6 +1530,12 @@ void preprocess(Compiler *comp, const char *source, int pageno) {
 	prepare(comp, source, pageno);
 	compiling = false;
 	labels = NULL;
+	label_list = NULL;
+	msg_buf = NULL;
+	msg_count = 0;
+	// Attached to the page at once, so that reset_page() frees it even if
+	// preprocess() fails.
+	definitions = comp->scos[pageno].definitions = new_vec();
 
 	toplevel();
 
@@ -1462,35 +1543,207 @@ void preprocess(Compiler *comp, const char *source, int pageno) {
 		error_at(menu_item_start, "unfinished menu item");
 	if (branch_end_stack && branch_end_stack->len > 0)
 		error_at(input, "'}' expected");
+
+	comp->scos[pageno].source = source;
+	comp->scos[pageno].msg_count = msg_count;
+	arena_reset(scratch_arena);
+}
+
+static void define_symbols(Compiler *comp, Vector *defs) {
+	for (int i = 0; i < defs->len; i++) {
+		Definition *def = defs->data[i];
+		const char *name = intern_name(comp, def->name);
+		Symbol *sym = hash_get(comp->symbols, name);
+		switch (def->type) {
+		case DEF_VARIABLE:
+			if (sym) {
+				if (sym->type == CONST)
+					error_at(def->source_loc, "'%s' is already defined as a constant", def->name);
+				break;
+			}
+			hash_put(comp->symbols, name, new_symbol(comp->arena, VARIABLE, comp->variables->len));
+			vec_push(comp->variables, (char *)name);
+			break;
+		case DEF_CONST:
+			if (sym) {
+				switch (sym->type) {
+				case VARIABLE:
+					error_at(def->source_loc, "'%s' is already defined as a variable", def->name);
+				case CONST:
+					error_at(def->source_loc, "constant '%s' redefined", def->name);
+				}
+			}
+			hash_put(comp->symbols, name, new_symbol(comp->arena, CONST, def->value));
+			break;
+		case DEF_FUNCTION:
+			if (hash_get(comp->functions, name))
+				error_at(def->source_loc, "function '%s' redefined", def->name);
+			def->func->name = name;
+			for (int j = 0; j < def->func->params->len; j++)
+				def->func->params->data[j] = (char *)intern_name(comp, def->func->params->data[j]);
+			hash_put(comp->functions, name, def->func);
+			break;
+		}
+	}
 }
 
 void preprocess_done(Compiler *comp) {
+	// Add definitions to the symbol tables in the same order as a serial scan
+	// of the pages, so that variable indices do not depend on scheduling.
+	for (int i = 0; i < comp->src_paths->len; i++) {
+		Sco *sco = &comp->scos[i];
+		if (!sco->definitions)
+			continue;
+		lexer_init(sco->source, comp->src_paths->data[i], i);  // for error_at()
+		define_symbols(comp, sco->definitions);
+	}
+
 	if (config.sys_ver == SYSTEM39)
 		comp->msg_buf = new_buf();
+	// Assign message IDs so that pages can be compiled in any order.
 	comp->msg_count = 0;
+	for (int i = 0; i < comp->src_paths->len; i++) {
+		comp->scos[i].msg_start = comp->msg_count;
+		comp->msg_count += comp->scos[i].msg_count;
+	}
+}
+
+static void resolve_func_refs(Buffer *buf, Vector *refs) {
+	for (int i = 0; i < refs->len; i++) {
+		FuncRef *ref = refs->data[i];
+		assert(ref->func->resolved);
+		swap_word(buf, ref->addr, ref->func->page);
+		swap_dword(buf, ref->addr + 2, ref->func->addr);
+	}
+}
+
+// Runs the peephole optimizer on the current page, and relocates everything
+// that refers to addresses in the page.
+static void optimize_page(int pageno) {
+	int len = current_address(out);
+	int *addr_map = peephole_run(peephole, out);
+	free_peephole(peephole);
+
+	for (int i = 0; i < label_list->len; i++) {
+		Label *l = label_list->data[i];
+		l->addr = addr_map[l->addr];
+	}
+	for (HashItem *i = hash_iterate(compiler->functions, NULL); i; i = hash_iterate(compiler->functions, i)) {
+		Function *func = i->val;
+		if (func->page == pageno + 1)
+			func->addr = addr_map[func->addr];
+	}
+	for (int i = 0; i < func_refs->len; i++) {
+		FuncRef *ref = func_refs->data[i];
+		ref->addr = addr_map[ref->addr];
+	}
+	Vector *msg_refs = compiler->scos[pageno].msg_refs;
+	for (int i = 0; i < msg_refs->len; i++)
+		msg_refs->data[i] = (void *)(uintptr_t)addr_map[(uintptr_t)msg_refs->data[i]];
+	if (compiler->dbg_info)
+		debug_line_relocate(compiler->dbg_info, pageno, addr_map);
+	compiler->scos[pageno].bytes_saved = len - current_address(out);
+	free(addr_map);
 }
 
 Sco *compile(Compiler *comp, const char *source, int pageno) {
 	prepare(comp, source, pageno);
 	compiling = true;
-	labels = new_map();
+	labels = new_hashed_string_hash();
+	label_list = new_vec();
+	func_refs = new_vec();
+	msg_buf = config.sys_ver == SYSTEM39 ? new_buf() : NULL;
+	msg_count = comp->scos[pageno].msg_start;
 
 	comp->scos[pageno].ald_volume = 1;
+	comp->scos[pageno].bytes_saved = 0;
+	comp->scos[pageno].page_refs = new_vec();
+	comp->scos[pageno].msg_refs = new_vec();
+	comp->scos[pageno].dynamic_page_refs = false;
+	comp->scos[pageno].unreachable = false;
 	out = new_buf();
 	sco_init(out, basename_utf8(comp->src_paths->data[pageno]), pageno);
 	if (comp->dbg_info)
 		debug_init_page(comp->dbg_info, pageno);
+	peephole = config.optimize >= 2 ? new_peephole() : NULL;
 
 	toplevel();
 
 	if (menu_item_start)
 		error_at(menu_item_start, "unfinished menu item");
 	check_undefined_labels();
+	if (peephole)
+		optimize_page(pageno);
+
+	// References to functions in this page can be resolved now. The others
+	// are left for compile_done(). All of them are kept in the Sco, as
+	// --strip-dead needs to know which functions are called.
+	for (int i = 0; i < func_refs->len; i++) {
+		FuncRef *ref = func_refs->data[i];
+		if (ref->func->page == pageno + 1) {
+			swap_word(out, ref->addr, ref->func->page);
+			swap_dword(out, ref->addr + 2, ref->func->addr);
+		}
+	}
 
 	sco_finalize(out);
 	if (comp->dbg_info)
-		debug_finish_page(comp->dbg_info, labels);
-	comp->scos[pageno].buf = out;
+		debug_finish_page(comp->dbg_info, pageno, label_list);
+	Sco *sco = &comp->scos[pageno];
+	sco->buf = out;
+	sco->func_refs = func_refs;
+	sco->msg_buf = msg_buf;
+	sco->nr_labels = label_list->len;
 	out = NULL;
-	return &comp->scos[pageno];
+	peephole = NULL;
+	arena_reset(scratch_arena);
+	return sco;
+}
+
+// Builds comp->msg_buf from the messages of the pages, giving identical
+// messages the same ID (--dedup-messages). Messages of pages removed by
+// --strip-dead are dropped.
+static void dedup_messages(Compiler *comp) {
+	HashMap *ids = new_string_hash();
+	int nr_messages = 0;
+	for (int i = 0; i < comp->src_paths->len; i++) {
+		Sco *sco = &comp->scos[i];
+		if (!sco->msg_buf || sco->unreachable)
+			continue;
+		// Maps the message IDs of the page to the new ones.
+		int *new_ids = malloc((sco->msg_count + 1) * sizeof(int));
+		const char *msg = (const char *)sco->msg_buf->buf;
+		for (int j = 0; j < sco->msg_count; j++) {
+			void *id = hash_get(ids, msg);
+			if (!id) {
+				id = (void *)(uintptr_t)++nr_messages;  // 1-based, as NULL means not found
+				hash_put(ids, msg, id);
+				emit_string(comp->msg_buf, msg);
+				emit(comp->msg_buf, 0);
+			}
+			new_ids[j] = (uintptr_t)id - 1;
+			msg += strlen(msg) + 1;
+		}
+		for (int j = 0; j < sco->msg_refs->len; j++) {
+			uint32_t addr = (uintptr_t)sco->msg_refs->data[j];
+			uint32_t old_id = le32(sco->buf->buf + addr);
+			assert(old_id >= sco->msg_start && old_id - sco->msg_start < sco->msg_count);
+			swap_dword(sco->buf, addr, new_ids[old_id - sco->msg_start]);
+		}
+		free(new_ids);
+	}
+	comp->msg_count = nr_messages;
+}
+
+void compile_done(Compiler *comp) {
+	for (int i = 0; i < comp->src_paths->len; i++) {
+		Sco *sco = &comp->scos[i];
+		resolve_func_refs(sco->buf, sco->func_refs);
+		if (comp->msg_buf && sco->msg_buf && !config.dedup_messages) {
+			for (int j = 0; j < sco->msg_buf->len; j++)
+				emit(comp->msg_buf, sco->msg_buf->buf[j]);
+		}
+	}
+	if (comp->msg_buf && config.dedup_messages)
+		dedup_messages(comp);
 }
@@ -0,0 +1,93 @@
+/* Copyright (C) 2026 <KichikuouChrome@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+*/
+#include "xsys35c.h"
+#include <stdlib.h>
+#include <string.h>
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double compile_page_time(const char *source, double *preprocess_time) {
+	Vector *src_names = new_vec();
+	vec_push(src_names, "bench.adv");
+	Compiler *compiler = new_compiler(src_names, NULL, NULL);
+
+	double start = now();
+	preprocess(compiler, source, 0);
+	preprocess_done(compiler);
+	if (preprocess_time)
+		*preprocess_time = now() - start;
+	compile(compiler, source, 0);
+	compile_done(compiler);
+	return now() - start;
+}
+
+// A page with n labels, each of which is jumped to from somewhere else in
+// the page (forward or backward).
+static char *labels_page(int n) {
+	char *buf = malloc(n * 32 + 1);
+	char *p = buf;
+	for (int i = 0; i < n; i++)
+		p += sprintf(p, "*L%d:\n@L%d:\n", i, (int)((i * 7919LL) % n));
+	return buf;
+}
+
+static void bench_labels(void) {
+	for (int n = 6250; n <= 50000; n *= 2) {
+		double t = compile_page_time(labels_page(n), NULL);
+		printf("labels: %6d labels %8.2f ms\n", n, t * 1000);
+	}
+}
+
+// A page of messages, mostly long runs of multibyte text, with indentation
+// and comments as in typical scenario scripts.
+static char *messages_page(int lines) {
+	static const char *text[] = {
+		"\t'あいうえおかきくけこさしすせそたちつてとなにぬねの'\n",
+		"\t\t'「はひふへほまみむめも、やゆよらりるれろわをん」'\n",
+		"\tR\n",
+		"\t; コメント comment\n",
+		"\t// ABC: abcdefghijklmnopqrstuvwxyz 0123456789\n",
+		"\tA\n",
+	};
+	int n = sizeof(text) / sizeof(text[0]);
+	Buffer *b = new_buf();
+	for (int i = 0; i < lines; i++)
+		emit_string(b, text[i % n]);
+	emit(b, 0);
+	return (char *)b->buf;
+}
+
+static void bench_lexer(void) {
+	char *source = messages_page(60000);
+	double mb = strlen(source) / 1e6;
+	double preprocess_time;
+	double t = compile_page_time(source, &preprocess_time);
+	printf("lexer: %.1f MB scanned %8.1f MB/s\n", mb, mb / preprocess_time);
+	printf("lexer: %.1f MB compiled %7.1f MB/s\n", mb, mb / t);
+}
+
+int main() {
+	config.sys_ver = SYSTEM35;
+
+	bench_labels();
+	bench_lexer();
+}
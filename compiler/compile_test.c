@@ -41,6 +41,7 @@ static void test(const char *name, const char *source,
 	vec_push(variables, "V");
 	Compiler *compiler = new_compiler(src_names, variables, NULL);
 	preprocess(compiler, source, 0);
+	preprocess_done(compiler);
 
 	compiler->msg_count = 0;
 
@@ -180,6 +181,33 @@ void compile_test(void) {
 		 "!V:__LINE__+\n__LINE__!",
 		 "\x21\x80\x41\x42\x79\x7f");
 
+	config.optimize = 1;
+	TEST("fold",
+		 "!V:3*40+2!",
+		 "\x21\x80\x00\x7a\x7f");
+	TEST("fold-const",
+		 "const word C=10: !V:C*C-1!",
+		 "\x21\x80\x00\x63\x7f");
+	TEST("fold-partial",
+		 "!V:V+2*3!",
+		 "\x21\x80\x80\x46\x79\x7f");
+	TEST("fold-compare",
+		 "!V:(1<2)+(3=4)!",
+		 "\x21\x80\x41\x7f");
+	TEST("fold-big",
+		 "!V:0x7fff+1!",
+		 "\x21\x80\x3f\xff\x3f\xff\x42\x79\x79\x7f");
+	TEST("fold-overflow",
+		 "!V:300*300!",
+		 "\x21\x80\x01\x2c\x01\x2c\x77\x7f");
+	TEST("fold-underflow",
+		 "!V:1-2!",
+		 "\x21\x80\x41\x42\x7a\x7f");
+	TEST("fold-div0",
+		 "!V:1/0!",
+		 "\x21\x80\x41\x40\x78\x7f");
+	config.optimize = 0;
+
 	TEST("label",
 		 "*lbl:@lbl:",
 		 "\x40\x20\x00\x00\x00");
@@ -268,6 +296,21 @@ void compile_test(void) {
 		 "\x7b\x40\x7f\x2d\x00\x00\x00\x41\x40\x3b\x00\x00\x00\x7b\x41\x7f"
 		 "\x3a\x00\x00\x00\x41\x40\x3b\x00\x00\x00\x41");
 
+	config.optimize = 2;
+	TEST("peep-else", "{V:A}A", "\x7b\x80\x7f\x28\x00\x00\x00\x41\x41");
+	TEST("peep-empty", "{V:}{V:{V:}}A", "A");
+	TEST("peep-self", "!V:V!A", "A");
+	TEST("peep-thread",
+		 "@a: *b: A *a: @b:",
+		 "\x41\x40\x20\x00\x00\x00");
+	TEST("peep-loop",
+		 "<@V:{V:}>",
+		 "\x7b\x80\x7f\x2c\x00\x00\x00\x3e\x20\x00\x00\x00");
+	TEST("peep-funcall",
+		 "!X:0! ~f X: **f X:",
+		 "\x21\x81\x40\x7f\x7e\x01\x00\x2b\x00\x00\x00");
+	config.optimize = 0;
+
 	TEST("newMT",
 		 "MT \"Title\":",
 		 "/(Title\0");
@@ -17,11 +17,15 @@
 */
 
 void compile_test(void);
+void debuginfo_test(void);
 void hel_test(void);
+void scan_test(void);
 void sco_test(void);
 
 int main() {
 	compile_test();
+	debuginfo_test();
 	hel_test();
+	scan_test();
 	sco_test();
 }
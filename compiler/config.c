@@ -106,10 +106,17 @@ void load_config(FILE *fp, const char *cfg_dir) {
 			config.output_ain = path_join(cfg_dir, val);
 		} else if (sscanf(line, "ain_version = %d", &intval)) {
 			config.ain_version = intval;
+		} else if (sscanf(line, "dsym_version = %d", &intval)) {
+			config.dsym_version = intval;
 		} else if (sscanf(line, "unicode = %s", val)) {
 			config.unicode = to_bool(val);
 		} else if (sscanf(line, "debug = %s", val)) {
 			config.debug = to_bool(val);
+		} else if (sscanf(line, "exports = %s", val)) {
+			if (!config.exports)
+				config.exports = new_vec();
+			for (char *name = strtok(val, ","); name; name = strtok(NULL, ","))
+				vec_push(config.exports, strdup(name));
 		}
 	}
 }
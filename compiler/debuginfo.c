@@ -17,17 +17,61 @@
 */
 #include "xsys35c.h"
 #include <assert.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <zlib.h>
 
-#define DSYM_VERSION 0
+// The debug information file (<ald_basename>SA.ALD.symbols) starts with a
+// header ("DSYM", version, number of sections), followed by sections, each of
+// which starts with a 4-byte tag and its length (including the tag).
+//
+// In version 1, every section is padded to a multiple of 4 bytes, and the
+// SCNT, LINE and FUNC sections are laid out so that a debugger can use them
+// on the mmap()ed file without decoding them entirely:
+//
+// SCNT:
+//   uint32 nr_files
+//   struct { uint32 offset, compressed_size, size; } files[]
+//   Each source text (without the terminating null) is compressed into an
+//   independent zlib stream, so that a single file can be inflated.
+//
+// LINE:
+//   uint32 nr_pages
+//   struct { uint32 nr_lines, nr_blocks, index_offset, data_offset; } pages[]
+//   For each page:
+//     struct { uint32 addr, line, offset; } index[nr_blocks]
+//     uint8 data[]
+//   The line entries of a page (sorted by address) are grouped into blocks
+//   of LINE_BLOCK_SIZE entries. The first entry of a block is stored in the
+//   index, and the rest are stored at data_offset + offset in data[] as
+//   pairs of ULEB128(address delta) and ULEB128(zigzag(line delta)) from
+//   the previous entry, where zigzag(d) = (d << 1) ^ (d >> 31), i.e.
+//   0, -1, 1, -2, ... are mapped to 0, 1, 2, 3, ...
+//
+// FUNC:
+//   uint32 nr_funcs
+//   struct { uint32 addr; uint16 page; uint8 is_local, reserved;
+//            uint32 name_offset; } funcs[]  // sorted by (page, addr)
+//   char names[]  // null-terminated
+//
+// All offsets are from the beginning of the section.
+
+#define LINE_BLOCK_SIZE 64
 
 typedef struct {
 	int line;
 	int addr;
 } LineInfo;
 
+// Line table of a page, in address order.
+typedef struct {
+	LineInfo *entries;
+	int len;
+	int cap;
+} LineTable;
+
 typedef struct {
 	const char *name;
 	int page;
@@ -35,11 +79,14 @@ typedef struct {
 	bool is_local;
 } FuncInfo;
 
+// Pages may be compiled in parallel, so line tables and local functions are
+// collected per page, and merged in debug_info_write().
 typedef struct DebugInfo {
 	Map *srcs;
-	Buffer *line_section;
-	Vector *linemap;
 	int nr_files;
+	LineTable *lines;  // for each page
+	Vector **local_functions;  // FuncInfos for each page
+	Arena **arenas;  // for FuncInfos of each page
 	Vector *functions;
 } DebugInfo;
 
@@ -48,21 +95,32 @@ struct DebugInfo *new_debug_info(Map *srcs) {
 	di->srcs = new_map();
 	for (int i = 0; i < srcs->keys->len; i++)
 		map_put(di->srcs, basename_utf8(srcs->keys->data[i]), srcs->vals->data[i]);
+	di->nr_files = srcs->keys->len;
+	di->lines = calloc(di->nr_files, sizeof(LineTable));
+	di->local_functions = calloc(di->nr_files, sizeof(Vector *));
+	di->arenas = calloc(di->nr_files, sizeof(Arena *));
 	di->functions = new_vec();
 	return di;
 }
 
-static void add_local_functions(struct DebugInfo *di, Map *labels, int page) {
-	for (int i = 0; i < labels->keys->len; i++) {
-		Label *label = labels->vals->data[i];
+static void init_line_table(LineTable *lt, int cap) {
+	lt->entries = malloc((cap ? cap : 1) * sizeof(LineInfo));
+	lt->len = 0;
+	lt->cap = cap ? cap : 1;
+}
+
+static void add_local_functions(struct DebugInfo *di, Vector *labels, int page) {
+	di->local_functions[page] = new_vec();
+	for (int i = 0; i < labels->len; i++) {
+		Label *label = labels->data[i];
 		if (!label->is_function)
 			continue;
-		FuncInfo *fi = calloc(1, sizeof(FuncInfo));
-		fi->name = labels->keys->data[i];
+		FuncInfo *fi = arena_alloc(di->arenas[page], sizeof(FuncInfo));
+		fi->name = arena_strdup(di->arenas[page], label->name);
 		fi->page = page;
 		fi->addr = label->addr;
 		fi->is_local = true;
-		vec_push(di->functions, fi);
+		vec_push(di->local_functions[page], fi);
 	}
 }
 
@@ -79,26 +137,17 @@ static void add_global_functions(struct DebugInfo *di, HashMap *functions) {
 }
 
 void debug_init_page(DebugInfo *di, int page) {
-	if (!di->line_section) {
-		di->line_section = new_buf();
-		emit(di->line_section, 'L');
-		emit(di->line_section, 'I');
-		emit(di->line_section, 'N');
-		emit(di->line_section, 'E');
-		emit_dword(di->line_section, 0);  // section length (to be filled later)
-		emit_dword(di->line_section, 0);  // nr_files (to be filled later)
-	}
-
-	assert(page == di->nr_files);
-	assert(!di->linemap);
-	di->linemap = new_vec();
+	assert(page < di->nr_files);
+	assert(!di->lines[page].entries);
+	init_line_table(&di->lines[page], 1024);
+	di->arenas[page] = new_arena();
 }
 
-void debug_line_add(DebugInfo *di, int line, int addr) {
-	Vector *linemap = di->linemap;
+void debug_line_add(DebugInfo *di, int page, int line, int addr) {
+	LineTable *lt = &di->lines[page];
 
-	if (linemap->len > 0) {
-		LineInfo *last = linemap->data[linemap->len - 1];
+	if (lt->len > 0) {
+		LineInfo *last = &lt->entries[lt->len - 1];
 		assert(addr >= last->addr);
 		assert(line >= last->line);
 		if (addr == last->addr) {
@@ -108,38 +157,125 @@ void debug_line_add(DebugInfo *di, int line, int addr) {
 		if (line == last->line)
 			return;
 	}
-	LineInfo *li = calloc(1, sizeof(LineInfo));
-	li->line = line;
-	li->addr = addr;
-	vec_push(linemap, li);
-	return;
+	if (lt->len == lt->cap) {
+		lt->cap *= 2;
+		lt->entries = realloc(lt->entries, lt->cap * sizeof(LineInfo));
+		if (!lt->entries)
+			error("out of memory");
+	}
+	lt->entries[lt->len++] = (LineInfo){ line, addr };
 }
 
-void debug_line_reset(DebugInfo *di) {
-	di->linemap->len = 0;
+void debug_line_reset(DebugInfo *di, int page) {
+	di->lines[page].len = 0;
 }
 
-void debug_finish_page(DebugInfo *di, Map *labels) {
-	add_local_functions(di, labels, di->nr_files);
+// Removes the line entries for the code after addr, which has been
+// discarded.
+void debug_line_truncate(DebugInfo *di, int page, int addr) {
+	LineTable *lt = &di->lines[page];
+	while (lt->len > 0 && lt->entries[lt->len - 1].addr > addr)
+		lt->len--;
+}
 
-	Vector *linemap = di->linemap;
-	assert(linemap);
+// Removes the line entries and local functions of a page stripped by
+// --strip-dead.
+void debug_clear_page(DebugInfo *di, int page) {
+	di->lines[page].len = 0;
+	di->local_functions[page]->len = 0;
+}
+
+// Updates the addresses of the line entries of a page after the peephole
+// optimizer has removed some code.
+void debug_line_relocate(DebugInfo *di, int page, const int *addr_map) {
+	LineTable *lt = &di->lines[page];
+	int n = 0;
+	for (int i = 0; i < lt->len; i++) {
+		LineInfo e = { lt->entries[i].line, addr_map[lt->entries[i].addr] };
+		if (n > 0 && lt->entries[n - 1].addr == e.addr)
+			lt->entries[n - 1].line = e.line;
+		else if (n == 0 || lt->entries[n - 1].line != e.line)
+			lt->entries[n++] = e;
+	}
+	lt->len = n;
+}
+
+void debug_finish_page(DebugInfo *di, int page, Vector *labels) {
+	add_local_functions(di, labels, page);
+
+	LineTable *lt = &di->lines[page];
+	assert(lt->entries);
 
 	// Drop the last entry because it points to the end address of the SCO.
-	if (linemap->len > 0)
-		linemap->len--;
+	if (lt->len > 0)
+		lt->len--;
+}
 
-	emit_dword(di->line_section, linemap->len);
-	for (int i = 0; i < linemap->len; i++) {
-		LineInfo *li = linemap->data[i];
-		emit_dword(di->line_section, li->line);
-		emit_dword(di->line_section, li->addr);
+// Serializes the debug information of a page, for the build cache.
+void debug_save_page(DebugInfo *di, int page, Buffer *out) {
+	LineTable *lt = &di->lines[page];
+	emit_dword(out, lt->len);
+	for (int i = 0; i < lt->len; i++) {
+		emit_dword(out, lt->entries[i].line);
+		emit_dword(out, lt->entries[i].addr);
+	}
+	Vector *funcs = di->local_functions[page];
+	emit_dword(out, funcs->len);
+	for (int i = 0; i < funcs->len; i++) {
+		FuncInfo *fi = funcs->data[i];
+		emit_string(out, fi->name);
+		emit(out, 0);
+		emit_dword(out, fi->addr);
 	}
-	di->linemap = NULL;
-	di->nr_files++;
+}
 
-	swap_dword(di->line_section, 4, di->line_section->len);
-	swap_dword(di->line_section, 8, di->nr_files);
+// Restores the debug information saved by debug_save_page(). Returns the
+// pointer to the end of the serialized data.
+const uint8_t *debug_load_page(DebugInfo *di, int page, const uint8_t *p) {
+	LineTable *lt = &di->lines[page];
+	assert(!lt->entries);
+	di->arenas[page] = new_arena();
+	int nr_lines = le32(p);
+	p += 4;
+	init_line_table(lt, nr_lines);
+	for (int i = 0; i < nr_lines; i++) {
+		lt->entries[i].line = le32(p);
+		lt->entries[i].addr = le32(p + 4);
+		p += 8;
+	}
+	lt->len = nr_lines;
+	Vector *funcs = di->local_functions[page] = new_vec();
+	int nr_funcs = le32(p);
+	p += 4;
+	for (int i = 0; i < nr_funcs; i++) {
+		FuncInfo *fi = arena_alloc(di->arenas[page], sizeof(FuncInfo));
+		fi->name = arena_strdup(di->arenas[page], (const char *)p);
+		p += strlen(fi->name) + 1;
+		fi->page = page;
+		fi->addr = le32(p);
+		p += 4;
+		fi->is_local = true;
+		vec_push(funcs, fi);
+	}
+	return p;
+}
+
+static void write_line_section(DebugInfo *di, FILE *fp) {
+	int section_len = 12;
+	for (int i = 0; i < di->nr_files; i++)
+		section_len += 4 + di->lines[i].len * 8;
+
+	fputs("LINE", fp);
+	fputdw(section_len, fp);
+	fputdw(di->nr_files, fp);
+	for (int i = 0; i < di->nr_files; i++) {
+		LineTable *lt = &di->lines[i];
+		fputdw(lt->len, fp);
+		for (int j = 0; j < lt->len; j++) {
+			fputdw(lt->entries[j].line, fp);
+			fputdw(lt->entries[j].addr, fp);
+		}
+	}
 }
 
 static void write_string_array_section(const char *tag, Vector *vec, FILE *fp) {
@@ -170,9 +306,6 @@ static void write_func_section(Vector *functions, FILE *fp) {
 	long section_length_offset = ftell(fp);
 	fputdw(0, fp);
 
-	// Sort by address.
-	qsort(functions->data, functions->len, sizeof(void *), funcinfo_compare);
-
 	fputdw(functions->len, fp);
 	for (int i = 0; i < functions->len; i++) {
 		FuncInfo *fi = functions->data[i];
@@ -189,16 +322,197 @@ static void write_func_section(Vector *functions, FILE *fp) {
 	fseek(fp, 0, SEEK_END);
 }
 
-void debug_info_write(struct DebugInfo *di, Compiler *compiler, FILE *fp) {
-	add_global_functions(di, compiler->functions);
-
+static void write_v0(DebugInfo *di, Compiler *compiler, FILE *fp) {
 	fputs("DSYM", fp);
-	fputdw(DSYM_VERSION, fp);
+	fputdw(0, fp);  // version
 	fputdw(5, fp);  // nr_sections
 
 	write_string_array_section("SRCS", di->srcs->keys, fp);
 	write_string_array_section("SCNT", di->srcs->vals, fp);
-	fwrite(di->line_section->buf, di->line_section->len, 1, fp);
+	write_line_section(di, fp);
 	write_func_section(di->functions, fp);
 	write_string_array_section("VARI", compiler->variables, fp);
 }
+
+// Version 1 sections are built in memory, because the offsets in LINE and
+// FUNC are known only after the data is emitted.
+
+static void emit_uleb128(Buffer *b, uint32_t v) {
+	while (v >= 0x80) {
+		emit(b, v | 0x80);
+		v >>= 7;
+	}
+	emit(b, v);
+}
+
+// Appends n zero bytes to b, and returns their offset.
+static int emit_zeros(Buffer *b, int n) {
+	int offset = b->len;
+	memset(emit_reserve(b, n), 0, n);
+	b->len += n;
+	return offset;
+}
+
+static void align4(Buffer *b) {
+	while (b->len % 4)
+		emit(b, 0);
+}
+
+// Returns the offset of the section, to be passed to end_section().
+static int begin_section(Buffer *b, const char *tag) {
+	int start = b->len;
+	emit_data(b, tag, 4);
+	emit_dword(b, 0);  // section length (to be filled later)
+	return start;
+}
+
+static void end_section(Buffer *b, int start) {
+	align4(b);
+	swap_dword(b, start + 4, b->len - start);
+}
+
+static void emit_string_array_section(Buffer *b, const char *tag, Vector *vec) {
+	int start = begin_section(b, tag);
+	emit_dword(b, vec->len);
+	for (int i = 0; i < vec->len; i++) {
+		emit_string(b, vec->data[i]);
+		emit(b, 0);
+	}
+	end_section(b, start);
+}
+
+typedef struct {
+	Vector *sources;
+	uint8_t **data;  // compressed
+	unsigned long *sizes;
+} CompressJob;
+
+static void compress_source(void *data, int i) {
+	CompressJob *job = data;
+	const char *src = job->sources->data[i];
+	unsigned long len = strlen(src);
+	unsigned long size = compressBound(len);
+	job->data[i] = malloc(size);
+	if (!job->data[i])
+		error("out of memory");
+	// Debug builds are part of the edit-compile cycle, so favor speed; the
+	// sources still shrink to about a sixth.
+	if (compress2(job->data[i], &size, (const uint8_t *)src, len, Z_BEST_SPEED) != Z_OK)
+		error("cannot compress %s", (char *)job->sources->data[i]);
+	job->sizes[i] = size;
+}
+
+static void emit_source_section(Buffer *b, Vector *sources, int jobs) {
+	int start = begin_section(b, "SCNT");
+	emit_dword(b, sources->len);
+	int table = emit_zeros(b, sources->len * 12);
+
+	CompressJob job = {
+		sources,
+		calloc(sources->len, sizeof(uint8_t *)),
+		calloc(sources->len, sizeof(unsigned long)),
+	};
+	parallel_for(sources->len, jobs, compress_source, &job);
+
+	for (int i = 0; i < sources->len; i++) {
+		int entry = table + i * 12;
+		swap_dword(b, entry, b->len - start);
+		swap_dword(b, entry + 4, job.sizes[i]);
+		swap_dword(b, entry + 8, strlen(sources->data[i]));
+		emit_data(b, job.data[i], job.sizes[i]);
+		free(job.data[i]);
+	}
+	free(job.data);
+	free(job.sizes);
+	end_section(b, start);
+}
+
+static void emit_line_section(Buffer *b, DebugInfo *di) {
+	int start = begin_section(b, "LINE");
+	emit_dword(b, di->nr_files);
+	int headers = emit_zeros(b, di->nr_files * 16);
+	for (int i = 0; i < di->nr_files; i++) {
+		LineTable *lt = &di->lines[i];
+		int nr_blocks = (lt->len + LINE_BLOCK_SIZE - 1) / LINE_BLOCK_SIZE;
+		int index = emit_zeros(b, nr_blocks * 12);
+		int data = b->len;
+		for (int j = 0; j < lt->len; j++) {
+			LineInfo *li = &lt->entries[j];
+			if (j % LINE_BLOCK_SIZE == 0) {
+				int entry = index + j / LINE_BLOCK_SIZE * 12;
+				swap_dword(b, entry, li->addr);
+				swap_dword(b, entry + 4, li->line);
+				swap_dword(b, entry + 8, b->len - data);
+			} else {
+				int dline = li->line - li[-1].line;
+				emit_uleb128(b, li->addr - li[-1].addr);
+				emit_uleb128(b, (uint32_t)dline << 1 ^ (uint32_t)(dline >> 31));
+			}
+		}
+		align4(b);
+
+		int header = headers + i * 16;
+		swap_dword(b, header, lt->len);
+		swap_dword(b, header + 4, nr_blocks);
+		swap_dword(b, header + 8, index - start);
+		swap_dword(b, header + 12, data - start);
+	}
+	end_section(b, start);
+}
+
+static void emit_func_section(Buffer *b, Vector *functions) {
+	int start = begin_section(b, "FUNC");
+	emit_dword(b, functions->len);
+	int records = emit_zeros(b, functions->len * 12);
+	for (int i = 0; i < functions->len; i++) {
+		FuncInfo *fi = functions->data[i];
+		int record = records + i * 12;
+		swap_dword(b, record, fi->addr);
+		swap_word(b, record + 4, fi->page);
+		set_byte(b, record + 6, fi->is_local);
+		swap_dword(b, record + 8, b->len - start);
+		emit_string(b, fi->name);
+		emit(b, 0);
+	}
+	end_section(b, start);
+}
+
+static void write_v1(DebugInfo *di, Compiler *compiler, FILE *fp, int jobs) {
+	Buffer *b = new_buf();
+	emit_data(b, "DSYM", 4);
+	emit_dword(b, 1);  // version
+	emit_dword(b, 5);  // nr_sections
+
+	emit_string_array_section(b, "SRCS", di->srcs->keys);
+	emit_source_section(b, di->srcs->vals, jobs);
+	emit_line_section(b, di);
+	emit_func_section(b, di->functions);
+	emit_string_array_section(b, "VARI", compiler->variables);
+
+	if (fwrite(b->buf, b->len, 1, fp) != 1)
+		error("cannot write debug information: %s", strerror(errno));
+}
+
+// Sources are compressed (version 1) with up to jobs threads.
+void debug_info_write(struct DebugInfo *di, Compiler *compiler, FILE *fp, int jobs) {
+	for (int i = 0; i < di->nr_files; i++) {
+		Vector *funcs = di->local_functions[i];
+		for (int j = 0; j < funcs->len; j++)
+			vec_push(di->functions, funcs->data[j]);
+	}
+	add_global_functions(di, compiler->functions);
+
+	// Sort by address.
+	qsort(di->functions->data, di->functions->len, sizeof(void *), funcinfo_compare);
+
+	switch (config.dsym_version) {
+	case 0:
+		write_v0(di, compiler, fp);
+		break;
+	case 1:
+		write_v1(di, compiler, fp, jobs);
+		break;
+	default:
+		error("unknown DSYM version: %d", config.dsym_version);
+	}
+}
@@ -0,0 +1,152 @@
+/* Copyright (C) 2026 <KichikuouChrome@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+*/
+#include "xsys35c.h"
+#undef NDEBUG
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#define NR_LINES 1000
+#define LINE_BLOCK_SIZE 64  // as in debuginfo.c
+
+static const uint8_t *find_section(const uint8_t *dsym, const char *tag) {
+	int nr_sections = le32(dsym + 8);
+	const uint8_t *p = dsym + 12;
+	for (int i = 0; i < nr_sections; i++) {
+		assert(le32(p + 4) % 4 == 0);
+		if (!memcmp(p, tag, 4))
+			return p;
+		p += le32(p + 4);
+	}
+	assert(!"section not found");
+	return NULL;
+}
+
+static uint32_t read_uleb128(const uint8_t **p) {
+	uint32_t v = 0;
+	for (int shift = 0;; shift += 7) {
+		uint8_t b = *(*p)++;
+		v |= (uint32_t)(b & 0x7f) << shift;
+		if (!(b & 0x80))
+			return v;
+	}
+}
+
+// Looks up the line of addr in page 0, as a debugger would do.
+static int lookup_line(const uint8_t *line_section, int addr) {
+	const uint8_t *page = line_section + 12;
+	int nr_lines = le32(page);
+	int nr_blocks = le32(page + 4);
+	const uint8_t *index = line_section + le32(page + 8);
+	const uint8_t *data = line_section + le32(page + 12);
+
+	int lo = 0, hi = nr_blocks;  // find the last block starting at or before addr
+	while (hi - lo > 1) {
+		int mid = (lo + hi) / 2;
+		if (le32(index + mid * 12) <= addr)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	const uint8_t *entry = index + lo * 12;
+	int a = le32(entry);
+	int line = le32(entry + 4);
+	if (a > addr)
+		return -1;
+	const uint8_t *p = data + le32(entry + 8);
+	int n = nr_lines - lo * LINE_BLOCK_SIZE;
+	for (int i = 1; i < LINE_BLOCK_SIZE && i < n; i++) {
+		uint32_t da = read_uleb128(&p);
+		uint32_t dl = read_uleb128(&p);
+		if (a + da > addr)
+			break;
+		a += da;
+		line += (int)(dl >> 1) ^ -(int)(dl & 1);
+	}
+	return line;
+}
+
+void debuginfo_test(void) {
+	Map *srcs = new_map();
+	const char *source = "\t!A:1!\n\t'message'\n\t!A:1!\n\t'message'\n";
+	map_put(srcs, "test.adv", (char *)source);
+	Vector *src_paths = new_vec();
+	vec_push(src_paths, "test.adv");
+	Compiler *compiler = new_compiler(src_paths, NULL, NULL);
+	struct DebugInfo *di = new_debug_info(srcs);
+
+	int lines[NR_LINES], addrs[NR_LINES];
+	debug_init_page(di, 0);
+	int line = 1, addr = 0;
+	for (int i = 0; i < NR_LINES; i++) {
+		lines[i] = line;
+		addrs[i] = addr;
+		debug_line_add(di, 0, line, addr);
+		line += 1 + (i % 7 == 0) * 200;
+		addr += 1 + (i * 37) % 500;
+	}
+	debug_line_add(di, 0, line, addr);  // end of the page, dropped
+
+	Vector *labels = new_vec();
+	Label func = { .name = "func", .addr = addrs[10], .is_function = true };
+	vec_push(labels, &func);
+	debug_finish_page(di, 0, labels);
+
+	config.dsym_version = 1;
+	FILE *fp = tmpfile();
+	debug_info_write(di, compiler, fp, 2);
+	long size = ftell(fp);
+	uint8_t *dsym = malloc(size);
+	rewind(fp);
+	assert(fread(dsym, size, 1, fp) == 1);
+	fclose(fp);
+
+	assert(!memcmp(dsym, "DSYM", 4));
+	assert(le32(dsym + 4) == 1);
+
+	const uint8_t *scnt = find_section(dsym, "SCNT");
+	assert(le32(scnt + 8) == 1);
+	unsigned long len = le32(scnt + 20);
+	assert(len == strlen(source));
+	char *text = malloc(len);
+	assert(uncompress((uint8_t *)text, &len, scnt + le32(scnt + 12), le32(scnt + 16)) == Z_OK);
+	assert(len == strlen(source) && !memcmp(text, source, len));
+	free(text);
+
+	const uint8_t *line_section = find_section(dsym, "LINE");
+	assert(le32(line_section + 8) == 1);
+	assert(le32(line_section + 12) == NR_LINES);
+	assert(lookup_line(line_section, 0) == 1);
+	for (int i = 0; i < NR_LINES; i++) {
+		assert(lookup_line(line_section, addrs[i]) == lines[i]);
+		if (i + 1 < NR_LINES && addrs[i + 1] > addrs[i] + 1)
+			assert(lookup_line(line_section, addrs[i + 1] - 1) == lines[i]);
+	}
+
+	const uint8_t *func_section = find_section(dsym, "FUNC");
+	assert(le32(func_section + 8) == 1);
+	const uint8_t *record = func_section + 12;
+	assert(le32(record) == addrs[10]);
+	assert(record[4] == 0 && record[5] == 0);  // page
+	assert(record[6] == 1);
+	assert(!strcmp((const char *)func_section + le32(record + 8), "func"));
+
+	config.dsym_version = 0;
+	free(dsym);
+}
@@ -21,11 +21,14 @@
 #include <stdlib.h>
 #include <string.h>
 
-const char *input_name;
-int input_page;
-const char *input_buf;
-const char *input;
-int input_line;
+// Lexer state is thread-local so that pages can be compiled in parallel.
+_Thread_local const char *input_name;
+_Thread_local int input_page;
+_Thread_local const char *input_buf;
+_Thread_local const char *input;
+_Thread_local int input_line;
+_Thread_local Arena *lexer_arena;
+_Thread_local Interner *lexer_names;
 
 void warn_at(const char *pos, char *fmt, ...) {
 	int line = 1;
@@ -61,10 +64,10 @@ void lexer_init(const char *source, const char *name, int pageno) {
 
 void skip_whitespaces(void) {
 	while (*input) {
-		if (*input == '\n') {
-			input++;
-			input_line++;
-		} else if (isspace(*input)) {
+		int newlines;
+		input = scan_blanks(input, &newlines);
+		input_line += newlines;
+		if (isspace(*input)) {
 			input++;
 		} else if (*input == ';' || (*input == '/' && *(input+1) == '/')) {
 			// This is safe because the input is guaranteed to end with "\n\0".
@@ -135,6 +138,12 @@ static void advance_to_next_char(void) {
 		;
 }
 
+// Identifiers are interned if they are in the symbol tables, so that looking
+// them up does not allocate or hash the string again.
+static char *token_dup(const char *s, size_t n) {
+	return (char *)intern_or_dup(lexer_names, lexer_arena, s, n);
+}
+
 char *get_identifier(void) {
 	skip_whitespaces();
 	const char *top = input;
@@ -142,7 +151,7 @@ char *get_identifier(void) {
 		error_at(top, "identifier expected");
 	while (is_identifier(*input))
 		advance_to_next_char();
-	return strndup_(top, input - top);
+	return token_dup(top, input - top);
 }
 
 char *get_label(void) {
@@ -152,7 +161,7 @@ char *get_label(void) {
 		advance_to_next_char();
 	if (input == top)
 		error_at(top, "label expected");
-	return strndup_(top, input - top);
+	return token_dup(top, input - top);
 }
 
 char *get_filename(void) {
@@ -161,7 +170,7 @@ char *get_filename(void) {
 		advance_to_next_char();
 	if (input == top)
 		error_at(top, "file name expected");
-	return strndup_(top, input - top);
+	return token_dup(top, input - top);
 }
 
 // number ::= [0-9]+ | '0' [xX] [0-9a-fA-F]+ | '0' [bB] [01]+
@@ -183,40 +192,16 @@ int get_number(void) {
 }
 
 static void compile_multibyte_string(Buffer *b, bool compact) {
+	const char *top = input;
+	input = scan_non_ascii(input);
 	if (config.unicode) {
-		while (!isascii(*input))
-			echo(b);
+		emit_data(b, top, input - top);
 		return;
 	}
-
-	const char *top = input;
-	while (!isascii(*input))
-		input++;
 	if (!b)
 		return;
-	char *buf = alloca(input - top + 1);
-	strncpy(buf, top, input - top);
-	buf[input - top] = '\0';
-	char *sjis = utf2sjis(buf);
-	if (!compact) {
-		emit_string(b, sjis);
-		return;
-	}
-	while (*sjis) {
-		uint8_t c1 = *sjis++;
-		if (!is_sjis_byte1(c1)) {
-			emit(b, c1);
-			continue;
-		}
-		uint8_t c2 = *sjis++;
-		uint8_t hk = compact_sjis(c1, c2);
-		if (hk) {
-			emit(b, hk);
-		} else {
-			emit(b, c1);
-			emit(b, c2);
-		}
-	}
+	// The SJIS text is never longer than the UTF-8 text.
+	b->len += utf2sjis_into(top, input - top, emit_reserve(b, input - top), compact);
 }
 
 void compile_sjis_codepoint(Buffer *b) {
@@ -237,6 +222,14 @@ void compile_sjis_codepoint(Buffer *b) {
 void compile_string(Buffer *b, char terminator, bool compact, bool forbid_ascii) {
 	const char *top = input;
 	while (*input != terminator) {
+		const char *end = scan_ascii(input, terminator, '<', '\\');
+		if (end != input) {
+			if (forbid_ascii)
+				error_at(input, "ASCII characters cannot be used here");
+			emit_data(b, input, end - input);
+			input = end;
+			continue;
+		}
 		if (*input == '<') {
 			compile_sjis_codepoint(b);
 			continue;
@@ -261,6 +254,12 @@ void compile_string(Buffer *b, char terminator, bool compact, bool forbid_ascii)
 void compile_message(Buffer *b) {
 	const char *top = input;
 	while (*input && *input != '\'') {
+		const char *end = scan_ascii(input, '\'', '<', '\\');
+		if (end != input) {
+			emit_data(b, input, end - input);
+			input = end;
+			continue;
+		}
 		if (*input == '<') {
 			compile_sjis_codepoint(b);
 			continue;
@@ -284,6 +283,12 @@ void compile_message(Buffer *b) {
 void compile_bare_string(Buffer *b) {
 	const char *top = input;
 	while (*input != ',' && *input != ':') {
+		const char *end = scan_ascii(input, ',', ':', ',');
+		if (end != input) {
+			emit_data(b, input, end - input);
+			input = end;
+			continue;
+		}
 		if (!*input)
 			error_at(top, "unfinished string argument");
 		if (isascii(*input))
@@ -295,160 +300,20 @@ void compile_bare_string(Buffer *b) {
 
 #define ISKEYWORD(s, len, kwd) ((len) == sizeof(kwd) - 1 && !memcmp((s), (kwd), (len)))
 
-static int lower_case_command(const char *s, int len) {
-#define LCCMD(cmd) if (ISKEYWORD(s, len, #cmd)) return COMMAND_ ## cmd
-	LCCMD(inc);
-	LCCMD(dec);
-	LCCMD(wavLoad);
-	LCCMD(wavPlay);
-	LCCMD(wavStop);
-	LCCMD(wavUnload);
-	LCCMD(wavIsPlay);
-	LCCMD(wavFade);
-	LCCMD(wavIsFade);
-	LCCMD(wavStopFade);
-	LCCMD(trace);
-	LCCMD(wav3DSetPos);
-	LCCMD(wav3DCommit);
-	LCCMD(wav3DGetPos);
-	LCCMD(wav3DSetPosL);
-	LCCMD(wav3DGetPosL);
-	LCCMD(wav3DFadePos);
-	LCCMD(wav3DIsFadePos);
-	LCCMD(wav3DStopFadePos);
-	LCCMD(wav3DFadePosL);
-	LCCMD(wav3DIsFadePosL);
-	LCCMD(wav3DStopFadePosL);
-	LCCMD(sndPlay);
-	LCCMD(sndStop);
-	LCCMD(sndIsPlay);
-	LCCMD(msg);
-	LCCMD(wavWaitTime);
-	LCCMD(wavGetPlayPos);
-	LCCMD(wavWaitEnd);
-	LCCMD(wavGetWaveTime);
-	LCCMD(menuSetCbkSelect);
-	LCCMD(menuSetCbkCancel);
-	LCCMD(menuClearCbkSelect);
-	LCCMD(menuClearCbkCancel);
-	LCCMD(wav3DSetMode);
-	LCCMD(grCopyStretch);
-	LCCMD(grFilterRect);
-	LCCMD(iptClearWheelCount);
-	LCCMD(iptGetWheelCount);
-	LCCMD(menuGetFontSize);
-	LCCMD(msgGetFontSize);
-	LCCMD(strGetCharType);
-	LCCMD(strGetLengthASCII);
-	LCCMD(sysWinMsgLock);
-	LCCMD(sysWinMsgUnlock);
-	LCCMD(aryCmpCount);
-	LCCMD(aryCmpTrans);
-	LCCMD(grBlendColorRect);
-	LCCMD(grDrawFillCircle);
-	LCCMD(menuSetCbkInit);
-	LCCMD(menuClearCbkInit);
-	LCCMD(menu);
-	LCCMD(sysOpenShell);
-	LCCMD(sysAddWebMenu);
-	LCCMD(iptSetMoveCursorTime);
-	LCCMD(iptGetMoveCursorTime);
-	LCCMD(grBlt);
-	LCCMD(sysGetOSName);
-	LCCMD(patchEC);
-	LCCMD(mathSetClipWindow);
-	LCCMD(mathClip);
-	LCCMD(strInputDlg);
-	LCCMD(strCheckASCII);
-	LCCMD(strCheckSJIS);
-	LCCMD(strMessageBox);
-	LCCMD(strMessageBoxStr);
-	LCCMD(grCopyUseAMapUseA);
-	LCCMD(grSetCEParam);
-	LCCMD(grEffectMoveView);
-	LCCMD(cgSetCacheSize);
-	LCCMD(gaijiSet);
-	LCCMD(gaijiClearAll);
-	LCCMD(menuGetLatestSelect);
-	LCCMD(lnkIsLink);
-	LCCMD(lnkIsData);
-	LCCMD(fncSetTable);
-	LCCMD(fncSetTableFromStr);
-	LCCMD(fncClearTable);
-	LCCMD(fncCall);
-	LCCMD(fncSetReturnCode);
-	LCCMD(fncGetReturnCode);
-	LCCMD(msgSetOutputFlag);
-	LCCMD(saveDeleteFile);
-	LCCMD(wav3DSetUseFlag);
-	LCCMD(wavFadeVolume);
-	LCCMD(patchEMEN);
-	LCCMD(wmenuEnableMsgSkip);
-	LCCMD(winGetFlipFlag);
-	LCCMD(cdGetMaxTrack);
-	LCCMD(dlgErrorOkCancel);
-	LCCMD(menuReduce);
-	LCCMD(menuGetNumof);
-	LCCMD(menuGetText);
-	LCCMD(menuGoto);
-	LCCMD(menuReturnGoto);
-	LCCMD(menuFreeShelterDIB);
-	LCCMD(msgFreeShelterDIB);
-	LCCMD(dataSetPointer);
-	LCCMD(dataGetWORD);
-	LCCMD(dataGetString);
-	LCCMD(dataSkipWORD);
-	LCCMD(dataSkipString);
-	LCCMD(varGetNumof);
-	LCCMD(patchG0);
-	LCCMD(regReadString);
-	LCCMD(fileCheckExist);
-	LCCMD(timeCheckCurDate);
-	LCCMD(dlgManualProtect);
-	LCCMD(fileCheckDVD);
-	LCCMD(sysReset);
-	return 0;
-#undef LCCMD
-}
-
-static int replace_command(int cmd) {
-	switch (cmd) {
-	case CMD3('T', 'A', 'A'): return COMMAND_TAA;
-	case CMD3('T', 'A', 'B'): return COMMAND_TAB;
-	}
-
-	if (config.sys_ver < SYSTEM38)
-		return cmd;
-
-	switch (cmd) {
-	case CMD3('T', 'O', 'C'): return COMMAND_TOC;
-	case CMD3('T', 'O', 'S'): return COMMAND_TOS;
-	case CMD3('T', 'P', 'C'): return COMMAND_TPC;
-	case CMD3('T', 'P', 'S'): return COMMAND_TPS;
-	case CMD3('T', 'O', 'P'): return COMMAND_TOP;
-	case CMD3('T', 'P', 'P'): return COMMAND_TPP;
-	case CMD2('H', 'H'): return use_ain_message() ? COMMAND_ainHH : COMMAND_newHH;
-	case CMD2('L', 'C'): return COMMAND_newLC;
-	case CMD2('L', 'E'): return COMMAND_newLE;
-	case CMD3('L', 'X', 'G'): return COMMAND_newLXG;
-	case CMD2('M', 'I'): return COMMAND_newMI;
-	case CMD2('M', 'S'): return COMMAND_newMS;
-	case CMD2('M', 'T'): return COMMAND_newMT;
-	case CMD2('N', 'T'): return COMMAND_newNT;
-	case CMD2('Q', 'E'): return COMMAND_newQE;
-	case CMD2('U', 'P'): return COMMAND_newUP;
-	case 'F': return COMMAND_newF;
-	case 'H': return use_ain_message() ? COMMAND_ainH : cmd;
-	case CMD3('M', 'H', 'H'): return COMMAND_MHH;
-	case CMD2(COMMAND_LXWx, 'T'): return COMMAND_LXWT;
-	case CMD2(COMMAND_LXWx, 'S'): return COMMAND_LXWS;
-	case CMD2(COMMAND_LXWx, 'E'): return COMMAND_LXWE;
-	case CMD2(COMMAND_LXWx, 'H'): return COMMAND_LXWH;
-	case CMD3(COMMAND_LXWx, 'H', 'H'): return COMMAND_LXWHH;
-	case CMD3('L', 'X', 'F'): return COMMAND_LXF;
-	case 'X': return use_ain_message() ? COMMAND_ainX : cmd;
-	default: return cmd;
+// Returns the "/xx" command that an upper-case command name cmd refers to, or
+// cmd itself if there is no such command.
+static int replace_command(int cmd, const char *name, int len) {
+	if (use_ain_message()) {
+		switch (cmd) {
+		case 'H': return COMMAND_ainH;
+		case CMD2('H', 'H'): return COMMAND_ainHH;
+		case 'X': return COMMAND_ainX;
+		}
 	}
+	const CommandInfo *info = lookup_command(name, len);
+	if (info && config.sys_ver >= info->since)
+		return info->code;
+	return cmd;
 }
 
 int get_command(Buffer *b) {
@@ -494,7 +359,7 @@ int get_command(Buffer *b) {
 		if (cmd == CMD2('Z', 'U'))
 			return cmd;
 
-		cmd = replace_command(cmd);
+		cmd = replace_command(cmd, command_top, input - command_top);
 		emit_command(b, cmd);
 		return cmd;
 	}
@@ -508,10 +373,10 @@ int get_command(Buffer *b) {
 			return COMMAND_CONST;
 		if (ISKEYWORD(command_top, len, "pragma"))
 			return COMMAND_PRAGMA;
-		int cmd = lower_case_command(command_top, len);
-		if (cmd) {
-			emit_command(b, cmd);
-			return cmd;
+		const CommandInfo *info = lookup_command(command_top, len);
+		if (info && config.sys_ver >= info->since) {
+			emit_command(b, info->code);
+			return info->code;
 		}
 		error_at(command_top, "Unknown command %.*s", len, command_top);
 	}
@@ -0,0 +1,341 @@
+/* Copyright (C) 2026 <KichikuouChrome@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+*/
+
+// Page objects. A page object holds the output of compile() for a page: the
+// SCO data whose references to functions are not resolved yet, a relocation
+// table for those references, the functions defined in the page, messages and
+// the addresses of their IDs, the pages it refers to (for --strip-dead) and
+// debug information. The build cache stores compiled pages in this form.
+//
+// Object files are laid out as follows:
+//   magic[4], key (u64), payload size (u32), payload, FNV-1a hash of payload (u64)
+// where key identifies the contents (see project_hash()).
+
+#include "xsys35c.h"
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+#define OBJECT_VERSION 5
+
+#define FNV_PRIME 1099511628211ULL
+
+uint64_t hash64(uint64_t h, const void *data, size_t len) {
+	// FNV-1a
+	const uint8_t *p = data;
+	for (size_t i = 0; i < len; i++) {
+		h ^= p[i];
+		h *= FNV_PRIME;
+	}
+	return h;
+}
+
+static uint64_t hash_int(uint64_t h, uint32_t v) {
+	uint8_t buf[4] = { v, v >> 8, v >> 16, v >> 24 };
+	return hash64(h, buf, 4);
+}
+
+static uint64_t hash_str(uint64_t h, const char *s) {
+	return hash64(h, s, strlen(s) + 1);
+}
+
+// Iteration order of a HashMap depends on its insertion history, so entries
+// are hashed individually and combined with an order-independent sum.
+static uint64_t hash_symbols(uint64_t h, HashMap *symbols) {
+	uint64_t sum = 0;
+	for (HashItem *i = hash_iterate(symbols, NULL); i; i = hash_iterate(symbols, i)) {
+		Symbol *sym = i->val;
+		uint64_t e = hash_str(HASH64_INIT, i->key);
+		e = hash_int(e, sym->type);
+		e = hash_int(e, sym->value);
+		sum += e;
+	}
+	return hash64(h, &sum, sizeof(sum));
+}
+
+static uint64_t hash_functions(uint64_t h, HashMap *functions) {
+	uint64_t sum = 0;
+	for (HashItem *i = hash_iterate(functions, NULL); i; i = hash_iterate(functions, i)) {
+		Function *func = i->val;
+		uint64_t e = hash_str(HASH64_INIT, func->name);
+		e = hash_int(e, func->page);
+		e = hash_int(e, func->params->len);
+		for (int j = 0; j < func->params->len; j++)
+			e = hash_str(e, func->params->data[j]);
+		sum += e;
+	}
+	return hash64(h, &sum, sizeof(sum));
+}
+
+static uint64_t hash_dlls(uint64_t h, Map *dlls) {
+	for (int i = 0; i < dlls->keys->len; i++) {
+		h = hash_str(h, dlls->keys->data[i]);
+		Vector *funcs = dlls->vals->data[i];
+		h = hash_int(h, funcs->len);
+		for (int j = 0; j < funcs->len; j++) {
+			DLLFunc *f = funcs->data[j];
+			h = hash_str(h, f->name);
+			h = hash_int(h, f->argc);
+			for (int k = 0; k < f->argc; k++)
+				h = hash_int(h, f->argtypes[k]);
+		}
+	}
+	return h;
+}
+
+// Returns a hash of everything but the page sources that compile() depends
+// on: the configuration, the list of pages, and the variable, constant,
+// function and DLL tables built by preprocess_done().
+uint64_t project_hash(Compiler *compiler) {
+	uint64_t h = hash_str(HASH64_INIT, VERSION);
+	h = hash_int(h, OBJECT_VERSION);
+	h = hash_int(h, config.sys_ver);
+	h = hash_int(h, config.sco_ver);
+	h = hash_int(h, config.debug);
+	h = hash_int(h, config.unicode);
+	h = hash_int(h, config.disable_else);
+	h = hash_int(h, config.disable_ain_message);
+	h = hash_int(h, config.old_SR);
+	h = hash_int(h, config.optimize);
+
+	h = hash_int(h, compiler->src_paths->len);
+	for (int i = 0; i < compiler->src_paths->len; i++)
+		h = hash_str(h, basename_utf8(compiler->src_paths->data[i]));
+	h = hash_int(h, compiler->variables->len);
+	for (int i = 0; i < compiler->variables->len; i++)
+		h = hash_str(h, compiler->variables->data[i]);
+	h = hash_symbols(h, compiler->symbols);
+	h = hash_functions(h, compiler->functions);
+	h = hash_dlls(h, compiler->dlls);
+	return h;
+}
+
+static void emit_qword(Buffer *b, uint64_t v) {
+	emit_dword(b, v);
+	emit_dword(b, v >> 32);
+}
+
+static void emit_bytes(Buffer *b, const uint8_t *data, int len) {
+	emit_dword(b, len);
+	for (int i = 0; i < len; i++)
+		emit(b, data[i]);
+}
+
+static void emit_cstring(Buffer *b, const char *s) {
+	emit_string(b, s);
+	emit(b, 0);
+}
+
+static const char *read_cstring(const uint8_t **p) {
+	const char *s = (const char *)*p;
+	*p += strlen(s) + 1;
+	return s;
+}
+
+static uint32_t read_dword(const uint8_t **p) {
+	uint32_t v = le32(*p);
+	*p += 4;
+	return v;
+}
+
+static Buffer *read_bytes(const uint8_t **p) {
+	int len = read_dword(p);
+	Buffer *b = malloc(sizeof(Buffer));
+	b->buf = malloc(len ? len : 1);
+	memcpy(b->buf, *p, len);
+	b->len = b->cap = len;
+	*p += len;
+	return b;
+}
+
+void write_object_file(const char *path, const char *magic, uint64_t key, Buffer *payload) {
+	Buffer *header = new_buf();
+	emit_string(header, magic);
+	emit_qword(header, key);
+	emit_dword(header, payload->len);
+	Buffer *trailer = new_buf();
+	emit_qword(trailer, hash64(HASH64_INIT, payload->buf, payload->len));
+
+	// Write to a temporary file and rename it, so that readers (including
+	// concurrent builds) never see a partially written file.
+	char *tmp_path = malloc(strlen(path) + 32);
+	sprintf(tmp_path, "%s.tmp.%d", path, (int)getpid());
+	FILE *fp = checked_fopen(tmp_path, "wb");
+	bool ok = fwrite(header->buf, header->len, 1, fp) == 1 &&
+		fwrite(payload->buf, 1, payload->len, fp) == payload->len &&
+		fwrite(trailer->buf, trailer->len, 1, fp) == 1;
+	if (fclose(fp) != 0 || !ok) {
+		remove(tmp_path);
+		error("%s: write error", path);
+	}
+	checked_rename(tmp_path, path);
+	free(tmp_path);
+	free(header->buf);
+	free(header);
+	free(trailer->buf);
+	free(trailer);
+}
+
+// Returns the payload of an object file, or NULL if the file does not exist
+// or is broken. The key of the file is stored in *key.
+const uint8_t *read_object_file(const char *path, const char *magic, uint64_t *key) {
+	FILE *fp = fopen(path, "rb");
+	if (!fp)
+		return NULL;
+	uint8_t header[16];
+	uint8_t *payload = NULL;
+	if (fread(header, sizeof(header), 1, fp) != 1 || memcmp(header, magic, 4))
+		goto broken;
+	// The payload and its hash must fill the rest of the file exactly, so a
+	// corrupt length is rejected before anything is allocated for it.
+	uint32_t len = le32(header + 12);
+	if (fseek(fp, 0, SEEK_END) != 0 || ftell(fp) != (long long)sizeof(header) + len + 8 ||
+		fseek(fp, sizeof(header), SEEK_SET) != 0)
+		goto broken;
+	payload = malloc((size_t)len + 8);
+	if (!payload || fread(payload, (size_t)len + 8, 1, fp) != 1 ||
+		le64(payload + len) != hash64(HASH64_INIT, payload, len))
+		goto broken;
+	fclose(fp);
+	*key = le64(header + 4);
+	return payload;
+
+ broken:
+	free(payload);
+	fclose(fp);
+	return NULL;
+}
+
+static Function *find_function(Compiler *compiler, const char *name) {
+	const char *key = intern_lookup(compiler->names, name, strlen(name));
+	return key ? hash_get(compiler->functions, key) : NULL;
+}
+
+// Serializes what compile() left in compiler->scos[page], and the addresses
+// of the functions defined in the page.
+void object_save_page(Compiler *compiler, int page, Buffer *out) {
+	Sco *sco = &compiler->scos[page];
+
+	emit_dword(out, sco->ald_volume);
+	emit_bytes(out, sco->buf->buf, sco->buf->len);
+
+	emit_dword(out, sco->func_refs->len);
+	for (int i = 0; i < sco->func_refs->len; i++) {
+		FuncRef *ref = sco->func_refs->data[i];
+		emit_dword(out, ref->addr);
+		emit_cstring(out, ref->func->name);
+	}
+
+	Vector *funcs = new_vec();
+	for (HashItem *i = hash_iterate(compiler->functions, NULL); i; i = hash_iterate(compiler->functions, i)) {
+		Function *func = i->val;
+		if (func->page == page + 1)
+			vec_push(funcs, func);
+	}
+	emit_dword(out, funcs->len);
+	for (int i = 0; i < funcs->len; i++) {
+		Function *func = funcs->data[i];
+		emit_cstring(out, func->name);
+		emit_dword(out, func->addr);
+	}
+
+	emit_dword(out, sco->msg_count);
+	if (sco->msg_buf)
+		emit_bytes(out, sco->msg_buf->buf, sco->msg_buf->len);
+	else
+		emit_dword(out, 0);
+
+	emit_dword(out, sco->msg_refs->len);
+	for (int i = 0; i < sco->msg_refs->len; i++)
+		emit_dword(out, (uintptr_t)sco->msg_refs->data[i]);
+
+	emit(out, sco->dynamic_page_refs);
+	emit_dword(out, sco->page_refs->len);
+	for (int i = 0; i < sco->page_refs->len; i++)
+		emit_dword(out, (intptr_t)sco->page_refs->data[i]);
+
+	if (compiler->dbg_info)
+		debug_save_page(compiler->dbg_info, page, out);
+}
+
+// Restores the data saved by object_save_page(). Returns false if it refers
+// to functions that are not in compiler->functions.
+bool object_load_page(Compiler *compiler, int page, const uint8_t *p) {
+	int ald_volume = read_dword(&p);
+	Buffer *buf = read_bytes(&p);
+
+	Vector *func_refs = new_vec();
+	int nr_refs = read_dword(&p);
+	for (int i = 0; i < nr_refs; i++) {
+		FuncRef *ref = arena_alloc(compiler->scos[page].arena, sizeof(FuncRef));
+		ref->addr = read_dword(&p);
+		ref->func = find_function(compiler, read_cstring(&p));
+		if (!ref->func)
+			return false;
+		vec_push(func_refs, ref);
+	}
+
+	// Make sure that all functions exist before updating them.
+	int nr_funcs = read_dword(&p);
+	const uint8_t *funcs = p;
+	for (int i = 0; i < nr_funcs; i++) {
+		Function *func = find_function(compiler, read_cstring(&p));
+		if (!func || func->page != page + 1)
+			return false;
+		p += 4;
+	}
+	p = funcs;
+	for (int i = 0; i < nr_funcs; i++) {
+		Function *func = find_function(compiler, read_cstring(&p));
+		func->addr = read_dword(&p);
+		func->resolved = true;
+	}
+
+	int msg_count = read_dword(&p);
+	Buffer *msg_buf = read_bytes(&p);
+
+	Vector *msg_refs = new_vec();
+	int nr_msg_refs = read_dword(&p);
+	for (int i = 0; i < nr_msg_refs; i++)
+		stack_push(msg_refs, read_dword(&p));
+
+	bool dynamic_page_refs = *p++;
+	Vector *page_refs = new_vec();
+	int nr_page_refs = read_dword(&p);
+	for (int i = 0; i < nr_page_refs; i++)
+		stack_push(page_refs, read_dword(&p));
+
+	Sco *sco = &compiler->scos[page];
+	sco->ald_volume = ald_volume;
+	sco->buf = buf;
+	sco->func_refs = func_refs;
+	sco->msg_count = msg_count;
+	sco->msg_buf = config.sys_ver == SYSTEM39 ? msg_buf : NULL;
+	sco->msg_refs = msg_refs;
+	sco->page_refs = page_refs;
+	sco->dynamic_page_refs = dynamic_page_refs;
+	sco->unreachable = false;
+	if (compiler->dbg_info)
+		debug_load_page(compiler->dbg_info, page, p);
+	return true;
+}
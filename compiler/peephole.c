@@ -0,0 +1,226 @@
+/* Copyright (C) 2026 <KichikuouChrome@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+*/
+
+// Peephole optimizer for compiled pages (-O2).
+//
+// SCO code cannot be decoded reliably without knowing where the data
+// (strings, data tables, etc.) is, so instead of disassembling the page, the
+// compiler tells the optimizer about the instructions it may rewrite and about
+// every operand that holds an address in the page. The optimizer then
+//
+//  - redirects jumps to '@' jumps to their final destinations (forward only,
+//    except for '@' jumps themselves),
+//  - removes '@' jumps to the next instruction (such as the else-jump of a
+//    conditional without an else clause),
+//  - removes conditionals with empty bodies (cali expressions have no side
+//    effects), and
+//  - removes self-assignments (!var:var!),
+//
+// and relocates the address operands. The removed bytes are simply skipped, so
+// an address inside a removed range moves to the next remaining instruction.
+
+#include "xsys35c.h"
+#include <assert.h>
+#include <stdlib.h>
+
+typedef struct {
+	int addr;  // address of the dword operand
+	bool branch;  // the operand is a jump destination
+} AddrRef;
+
+typedef struct {
+	int start;
+	int end;
+} Range;
+
+struct Peephole {
+	AddrRef *refs;
+	int nr_refs, refs_cap;
+	int *jumps;  // addresses of '@' instructions
+	int nr_jumps, jumps_cap;
+	Range *conds;  // '{' instructions; the false destination is at end - 4
+	int nr_conds, conds_cap;
+	Range *nops;  // instructions with no effect
+	int nr_nops, nops_cap;
+};
+
+// Makes room for one more element in an array of len elements.
+static void *grow(void *array, int len, int *cap, size_t size) {
+	if (len < *cap)
+		return array;
+	*cap = *cap ? *cap * 2 : 64;
+	array = realloc(array, *cap * size);
+	if (!array)
+		error("out of memory");
+	return array;
+}
+
+Peephole *new_peephole(void) {
+	return calloc(1, sizeof(Peephole));
+}
+
+void free_peephole(Peephole *p) {
+	free(p->refs);
+	free(p->jumps);
+	free(p->conds);
+	free(p->nops);
+	free(p);
+}
+
+void peephole_addr(Peephole *p, int addr, bool branch) {
+	p->refs = grow(p->refs, p->nr_refs, &p->refs_cap, sizeof(AddrRef));
+	p->refs[p->nr_refs++] = (AddrRef){ addr, branch };
+}
+
+void peephole_jump(Peephole *p, int addr) {
+	p->jumps = grow(p->jumps, p->nr_jumps, &p->jumps_cap, sizeof(int));
+	p->jumps[p->nr_jumps++] = addr;
+}
+
+void peephole_cond(Peephole *p, int start, int end) {
+	p->conds = grow(p->conds, p->nr_conds, &p->conds_cap, sizeof(Range));
+	p->conds[p->nr_conds++] = (Range){ start, end };
+}
+
+void peephole_nop(Peephole *p, int start, int end) {
+	p->nops = grow(p->nops, p->nr_nops, &p->nops_cap, sizeof(Range));
+	p->nops[p->nr_nops++] = (Range){ start, end };
+}
+
+// Forgets the records about the code at or after addr, which has been
+// discarded.
+void peephole_truncate(Peephole *p, int addr) {
+	int n = 0;
+	for (int i = 0; i < p->nr_refs; i++) {
+		if (p->refs[i].addr + 4 <= addr)
+			p->refs[n++] = p->refs[i];
+	}
+	p->nr_refs = n;
+	n = 0;
+	for (int i = 0; i < p->nr_jumps; i++) {
+		if (p->jumps[i] + 5 <= addr)
+			p->jumps[n++] = p->jumps[i];
+	}
+	p->nr_jumps = n;
+	n = 0;
+	for (int i = 0; i < p->nr_conds; i++) {
+		if (p->conds[i].end <= addr)
+			p->conds[n++] = p->conds[i];
+	}
+	p->nr_conds = n;
+	n = 0;
+	for (int i = 0; i < p->nr_nops; i++) {
+		if (p->nops[i].end <= addr)
+			p->nops[n++] = p->nops[i];
+	}
+	p->nr_nops = n;
+}
+
+static void mark_dead(bool *dead, int start, int end) {
+	for (int i = start; i < end; i++)
+		dead[i] = true;
+}
+
+static bool all_dead(const bool *dead, int start, int end) {
+	for (int i = start; i < end; i++) {
+		if (!dead[i])
+			return false;
+	}
+	return true;
+}
+
+// Removing an instruction can make a preceding jump or conditional empty, so
+// this repeats until nothing changes.
+static void remove_dead_code(Peephole *p, Buffer *buf, bool *dead) {
+	for (bool changed = true; changed;) {
+		changed = false;
+		for (int i = 0; i < p->nr_jumps; i++) {
+			int addr = p->jumps[i];
+			uint32_t dest = le32(buf->buf + addr + 1);
+			if (!dead[addr] && dest >= addr + 5 && all_dead(dead, addr + 5, dest)) {
+				mark_dead(dead, addr, addr + 5);
+				changed = true;
+			}
+		}
+		for (int i = 0; i < p->nr_conds; i++) {
+			Range *c = &p->conds[i];
+			uint32_t dest = le32(buf->buf + c->end - 4);
+			if (!dead[c->start] && dest >= c->end && all_dead(dead, c->end, dest)) {
+				mark_dead(dead, c->start, c->end);
+				changed = true;
+			}
+		}
+	}
+}
+
+int *peephole_run(Peephole *p, Buffer *buf) {
+	int len = buf->len;
+	bool *dead = calloc(len, sizeof(bool));
+	bool *is_jump = calloc(len, sizeof(bool));
+	for (int i = 0; i < p->nr_jumps; i++)
+		is_jump[p->jumps[i]] = true;
+
+	for (int i = 0; i < p->nr_nops; i++)
+		mark_dead(dead, p->nops[i].start, p->nops[i].end);
+
+	remove_dead_code(p, buf, dead);
+
+	// Jump threading. The number of steps is bounded for infinite loops.
+	// xsys35dc reconstructs conditionals and loops from their destinations,
+	// so only the operands of '@' jumps may be threaded to an earlier address.
+	for (int i = 0; i < p->nr_refs; i++) {
+		int addr = p->refs[i].addr;
+		if (!p->refs[i].branch || dead[addr])
+			continue;
+		bool is_jump_operand = addr > 0 && is_jump[addr - 1];
+		uint32_t dest = le32(buf->buf + addr);
+		for (int n = 0; dest < len && is_jump[dest] && n < p->nr_jumps; n++) {
+			uint32_t next = le32(buf->buf + dest + 1);
+			if (next <= addr && !is_jump_operand)
+				break;
+			dest = next;
+		}
+		swap_dword(buf, addr, dest);
+	}
+
+	remove_dead_code(p, buf, dead);
+
+	int *map = malloc((len + 1) * sizeof(int));
+	map[0] = 0;
+	for (int i = 0; i < len; i++)
+		map[i + 1] = map[i] + !dead[i];
+
+	for (int i = 0; i < p->nr_refs; i++) {
+		int addr = p->refs[i].addr;
+		if (!dead[addr]) {
+			uint32_t dest = le32(buf->buf + addr);
+			assert(dest <= len);
+			swap_dword(buf, addr, map[dest]);
+		}
+	}
+	int n = 0;
+	for (int i = 0; i < len; i++) {
+		if (!dead[i])
+			buf->buf[n++] = buf->buf[i];
+	}
+	buf->len = n;
+
+	free(dead);
+	free(is_jump);
+	return map;
+}
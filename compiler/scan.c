@@ -0,0 +1,135 @@
+/* Copyright (C) 2026 <KichikuouChrome@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+*/
+
+// Scanners that find the end of a run of "uninteresting" bytes in the lexer
+// input, 16 bytes at a time when SSE2 is available.
+//
+// Every scanner stops at '\0', so it never reads past the 16-byte aligned
+// block that contains the terminating null character. The vector loops use
+// aligned loads, which cannot cross a page boundary, but may read a few bytes
+// outside the string; hence the sanitizer attributes.
+
+#include "xsys35c.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && !defined(__clang__)
+#define NO_SANITIZE __attribute__((no_sanitize_address))
+#elif defined(__clang__)
+#define NO_SANITIZE __attribute__((no_sanitize("address")))
+#else
+#define NO_SANITIZE
+#endif
+
+#ifdef __SSE2__
+
+// Loads the aligned 16-byte block containing p. *valid is set to a mask of
+// the bytes at or after p.
+static inline const __m128i *aligned_block(const char *p, uint32_t *valid) {
+	uintptr_t off = (uintptr_t)p & 15;
+	*valid = 0xffff << off & 0xffff;
+	return (const __m128i *)(p - off);
+}
+
+NO_SANITIZE
+const char *scan_blanks(const char *p, int *newlines) {
+	const __m128i sp = _mm_set1_epi8(' ');
+	const __m128i tab = _mm_set1_epi8('\t');
+	const __m128i cr = _mm_set1_epi8('\r');
+	const __m128i lf = _mm_set1_epi8('\n');
+	uint32_t valid;
+	const __m128i *q = aligned_block(p, &valid);
+	int n = 0;
+	for (;; q++, valid = 0xffff) {
+		__m128i v = _mm_load_si128(q);
+		uint32_t nl = _mm_movemask_epi8(_mm_cmpeq_epi8(v, lf));
+		uint32_t blank = _mm_movemask_epi8(
+			_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, sp), _mm_cmpeq_epi8(v, tab)),
+						 _mm_cmpeq_epi8(v, cr))) | nl;
+		uint32_t stop = ~blank & valid;
+		if (stop) {
+			uint32_t before = (stop & -stop) - 1;
+			*newlines = n + __builtin_popcount(nl & valid & before);
+			return (const char *)q + __builtin_ctz(stop);
+		}
+		n += __builtin_popcount(nl & valid);
+	}
+}
+
+NO_SANITIZE
+const char *scan_non_ascii(const char *p) {
+	uint32_t valid;
+	const __m128i *q = aligned_block(p, &valid);
+	for (;; q++, valid = 0xffff) {
+		// The sign bit is clear for ASCII characters.
+		uint32_t stop = ~_mm_movemask_epi8(_mm_load_si128(q)) & valid;
+		if (stop)
+			return (const char *)q + __builtin_ctz(stop);
+	}
+}
+
+NO_SANITIZE
+const char *scan_ascii(const char *p, char c1, char c2, char c3) {
+	const __m128i control = _mm_set1_epi8(' ');
+	const __m128i v1 = _mm_set1_epi8(c1);
+	const __m128i v2 = _mm_set1_epi8(c2);
+	const __m128i v3 = _mm_set1_epi8(c3);
+	uint32_t valid;
+	const __m128i *q = aligned_block(p, &valid);
+	for (;; q++, valid = 0xffff) {
+		__m128i v = _mm_load_si128(q);
+		// Signed comparison; this also catches non-ASCII bytes.
+		__m128i m = _mm_cmplt_epi8(v, control);
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(v, v1));
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(v, v2));
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(v, v3));
+		uint32_t stop = _mm_movemask_epi8(m) & valid;
+		if (stop)
+			return (const char *)q + __builtin_ctz(stop);
+	}
+}
+
+#else  // __SSE2__
+
+const char *scan_blanks(const char *p, int *newlines) {
+	int n = 0;
+	for (;; p++) {
+		if (*p == '\n')
+			n++;
+		else if (*p != ' ' && *p != '\t' && *p != '\r')
+			break;
+	}
+	*newlines = n;
+	return p;
+}
+
+const char *scan_non_ascii(const char *p) {
+	while (*p & 0x80)
+		p++;
+	return p;
+}
+
+const char *scan_ascii(const char *p, char c1, char c2, char c3) {
+	while ((uint8_t)*p >= ' ' && (uint8_t)*p < 0x80 && *p != c1 && *p != c2 && *p != c3)
+		p++;
+	return p;
+}
+
+#endif  // __SSE2__
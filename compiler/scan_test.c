@@ -0,0 +1,64 @@
+/* Copyright (C) 2026 <KichikuouChrome@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+*/
+#include "xsys35c.h"
+#undef NDEBUG
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Scans the string at every offset within a 16-byte block, and compares the
+// results with a byte-at-a-time scan.
+static void check_scanners(const char *s) {
+	size_t len = strlen(s);
+	char *buf = aligned_alloc(16, (len + 16 + 15) & ~15);
+	for (int off = 0; off < 16; off++) {
+		char *p = buf + off;
+		memcpy(p, s, len + 1);
+
+		int newlines = 0;
+		const char *q = p;
+		for (; *q == ' ' || *q == '\t' || *q == '\r' || *q == '\n'; q++) {
+			if (*q == '\n')
+				newlines++;
+		}
+		int n;
+		assert(scan_blanks(p, &n) == q);
+		assert(n == newlines);
+
+		for (q = p; *q & 0x80; q++)
+			;
+		assert(scan_non_ascii(p) == q);
+
+		for (q = p; (uint8_t)*q >= ' ' && (uint8_t)*q < 0x80 && *q != '"' && *q != '<' && *q != '\\'; q++)
+			;
+		assert(scan_ascii(p, '"', '<', '\\') == q);
+	}
+	free(buf);
+}
+
+void scan_test(void) {
+	check_scanners("");
+	check_scanners("\n");
+	check_scanners(" \t\r\n x");
+	check_scanners("  \n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n  \n;comment\n");
+	check_scanners("\xe3\x81\x82\xe3\x81\x84\xe3\x81\x86\xe3\x81\x88\xe3\x81\x8a\xe3\x81\x8b\xe3\x81\x8d'");
+	check_scanners("hello, world. this is a long ascii string<0x8140>\"");
+	check_scanners("abcdefghijklmnopqrstuvwxyz\\\"");
+	check_scanners("abc\x7f" "def\tghi");
+	check_scanners("abcdefghijklmnopqrstuvwxyz0123456789\xe3\x81\x82");
+}
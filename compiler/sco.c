@@ -55,9 +55,26 @@ void emit_dword(Buffer *b, uint32_t v) {
 	emit(b, v >> 24 & 0xff);
 }
 
+// Makes room for len bytes at the end of b, and returns a pointer to it. The
+// caller adds the number of bytes it writes there to b->len.
+uint8_t *emit_reserve(Buffer *b, int len) {
+	if (b->len + len > b->cap) {
+		while (b->len + len > b->cap)
+			b->cap *= 2;
+		b->buf = realloc(b->buf, b->cap);
+	}
+	return b->buf + b->len;
+}
+
+void emit_data(Buffer *b, const void *data, int len) {
+	if (!b)
+		return;
+	memcpy(emit_reserve(b, len), data, len);
+	b->len += len;
+}
+
 void emit_string(Buffer *b, const char *s) {
-	while (*s)
-		emit(b, *s++);
+	emit_data(b, s, strlen(s));
 }
 
 int current_address(Buffer *b) {
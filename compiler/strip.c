@@ -0,0 +1,129 @@
+/* Copyright (C) 2026 <KichikuouChrome@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+*/
+
+// Dead code elimination at link time (--strip-dead).
+//
+// A page is reachable if it is page 0, or if a reachable page jumps to it or
+// calls it with a constant page number (&#page.adv: or %#page.adv:), or calls
+// a function defined in it (~func:, or fncSetTable), or it defines a function
+// listed in the "exports" configuration (functions called by name from
+// outside the scenario, such as from a DLL). Unreachable pages are replaced
+// by empty pages.
+//
+// A function is used if it is exported or called from a reachable page.
+// Unused functions are removed from the function table (and thus from
+// System39.ain). Functions have no end address in SCO, so the code of an
+// unused function in a reachable page is kept; such functions are listed by
+// --opt-report.
+//
+// If a reachable page jumps to a computed page number or looks up a function
+// by name (fncSetTableFromStr), any page and function may be used and nothing
+// is removed.
+
+#include "xsys35c.h"
+#include <stdlib.h>
+#include <string.h>
+
+static void mark_reachable(Compiler *comp, bool *reachable, Vector *queue, int page) {
+	if (page < 0 || page >= comp->src_paths->len || reachable[page])
+		return;
+	reachable[page] = true;
+	stack_push(queue, page);
+}
+
+static Function *find_function(Compiler *comp, const char *name) {
+	const char *key = intern_lookup(comp->names, name, strlen(name));
+	return key ? hash_get(comp->functions, key) : NULL;
+}
+
+static int compare_functions(const void *a, const void *b) {
+	const Function *fa = *(const Function **)a;
+	const Function *fb = *(const Function **)b;
+	if (fa->page != fb->page)
+		return fa->page - fb->page;
+	return fa->addr < fb->addr ? -1 : fa->addr > fb->addr;
+}
+
+// Must be called before compile_done(). Returns the number of removed
+// functions.
+int strip_dead_code(Compiler *comp) {
+	int nr_pages = comp->src_paths->len;
+	bool *reachable = calloc(nr_pages, sizeof(bool));
+	HashMap *used = new_hashed_string_hash();
+	Vector *queue = new_vec();
+	mark_reachable(comp, reachable, queue, 0);
+	for (int i = 0; config.exports && i < config.exports->len; i++) {
+		Function *func = find_function(comp, config.exports->data[i]);
+		if (!func) {
+			fprintf(stderr, "Warning: exported function '%s' is not defined\n", (char *)config.exports->data[i]);
+			continue;
+		}
+		hash_put(used, func->name, func);
+		mark_reachable(comp, reachable, queue, func->page - 1);
+	}
+	while (queue->len > 0) {
+		int page = stack_top(queue);
+		stack_pop(queue);
+		Sco *sco = &comp->scos[page];
+		if (sco->dynamic_page_refs) {
+			fprintf(stderr, "Warning: %s has a computed page jump or function call; nothing is stripped\n",
+					(char *)comp->src_paths->data[page]);
+			free(reachable);
+			return 0;
+		}
+		for (int i = 0; i < sco->page_refs->len; i++)
+			mark_reachable(comp, reachable, queue, (intptr_t)sco->page_refs->data[i]);
+		for (int i = 0; i < sco->func_refs->len; i++) {
+			FuncRef *ref = sco->func_refs->data[i];
+			hash_put(used, ref->func->name, ref->func);
+			mark_reachable(comp, reachable, queue, ref->func->page - 1);
+		}
+	}
+
+	for (int i = 0; i < nr_pages; i++) {
+		Sco *sco = &comp->scos[i];
+		if (reachable[i])
+			continue;
+		// Keep the SCO header only.
+		sco->buf->len = le32(sco->buf->buf + 4);
+		sco_finalize(sco->buf);
+		sco->func_refs = new_vec();
+		sco->unreachable = true;
+		if (comp->dbg_info)
+			debug_clear_page(comp->dbg_info, i);
+	}
+
+	HashMap *functions = new_hashed_string_hash();
+	Vector *unused = new_vec();
+	int nr_removed = 0;
+	for (HashItem *i = hash_iterate(comp->functions, NULL); i; i = hash_iterate(comp->functions, i)) {
+		Function *func = i->val;
+		if (hash_get(used, func->name)) {
+			hash_put(functions, i->key, func);
+			continue;
+		}
+		nr_removed++;
+		if (reachable[func->page - 1])
+			vec_push(unused, func);
+	}
+	qsort(unused->data, unused->len, sizeof(Function *), compare_functions);
+	comp->functions = functions;
+	comp->unused_functions = unused;
+	free(reachable);
+	return nr_removed;
+}
@@ -22,25 +22,48 @@
 #include <limits.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <time.h>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 #define DEFAULT_ALD_BASENAME "out"
 #define DEFAULT_OUTPUT_AIN "System39.ain"
 
-static const char short_options[] = "a:E:ghi:Io:p:s:uV:v";
+static const char short_options[] = "a:E:ghi:Ij:o:O::p:s:uV:v";
 static const struct option long_options[] = {
 	{ "ain",       required_argument, NULL, 'a' },
 	{ "ald",       required_argument, NULL, 'o' },
+	{ "cache-dir", required_argument, NULL, 'c' },
 	{ "debug",     no_argument,       NULL, 'g' },
+	{ "dedup-messages", no_argument,  NULL, 'U' },
 	{ "encoding",  required_argument, NULL, 'E' },
 	{ "hed",       required_argument, NULL, 'i' },
 	{ "help",      no_argument,       NULL, 'h' },
 	{ "init",      no_argument,       NULL, 'I' },
+	{ "jobs",      required_argument, NULL, 'j' },
+	{ "mem-report", no_argument,      NULL, 'M' },
+	{ "opt-report", no_argument,      NULL, 'R' },
+	{ "optimize",  optional_argument, NULL, 'O' },
 	{ "project",   required_argument, NULL, 'p' },
+	{ "serve",     required_argument, NULL, 'S' },
+	{ "strip-dead", no_argument,      NULL, 'D' },
 	{ "sys-ver",   required_argument, NULL, 's' },
+	{ "time-report", optional_argument, NULL, 'T' },
 	{ "unicode",   no_argument,       NULL, 'u' },
 	{ "variables", required_argument, NULL, 'V' },
 	{ "version",   no_argument,       NULL, 'v' },
+	{ "watch",     no_argument,       NULL, 'W' },
 	{ 0, 0, 0, 0 }
 };
 
@@ -49,17 +72,27 @@ static void usage(void) {
 	puts("Options:");
 	puts("    -a, --ain <file>          Write .ain output to <file> (default: " DEFAULT_OUTPUT_AIN ")");
 	puts("    -o, --ald <name>          Write output to <name>SA.ALD, <name>SB.ALD, ... (default: " DEFAULT_ALD_BASENAME ")");
+	puts("        --cache-dir <dir>     Reuse compiled pages from the build cache in <dir>");
 	puts("    -g, --debug               Generate debug information");
+	puts("        --dedup-messages      Store identical messages only once in " DEFAULT_OUTPUT_AIN);
 	puts("    -Es, --encoding=sjis      Set input coding system to SJIS");
 	puts("    -Eu, --encoding=utf8      Set input coding system to UTF-8 (default)");
 	puts("    -i, --hed <file>          Read compile header (.hed) from <file>");
 	puts("    -h, --help                Display this message and exit");
 	puts("    -I, --init                Create a new xsys35c project");
+	puts("    -j, --jobs <n>            Process <n> source files in parallel (default: 1)");
+	puts("        --mem-report          Print memory usage of each compilation phase");
+	puts("    -O, --optimize[=<level>]  Optimize the generated code (level 0 (default), 1 or 2)");
+	puts("        --opt-report          Print the effect of the optimizations on each page");
 	puts("    -p, --project <file>      Read project configuration from <file>");
+	puts("        --serve <socket>      Run as a compile server listening on <socket>");
+	puts("        --strip-dead          Remove pages and functions that are never used");
 	puts("    -s, --sys-ver <ver>       Target System version (3.5|3.6|3.8|3.9(default))");
+	puts("        --time-report[=json]  Print the time spent in each compilation phase");
 	puts("    -u, --unicode             Generate Unicode output (can only be run on xsystem35)");
 	puts("    -V, --variables <file>    Read list of variables from <file>");
 	puts("    -v, --version             Print version information and exit");
+	puts("        --watch               Rebuild whenever an input file changes");
 }
 
 static void version(void) {
@@ -80,21 +113,62 @@ static char *next_line(char **buf) {
 	return line;
 }
 
-static char *read_file(const char *path) {
+#ifndef _WIN32
+// Set in the compile server and watch mode, which keep the sources across
+// builds. A mapping would follow an editor rewriting the file in place, and
+// reading past the end of a truncated file raises SIGBUS.
+static bool copy_sources;
+
+// Maps a file into memory, followed by "\n\0" as read_file() does, without
+// copying it. The pages past the end of the file come from an anonymous
+// mapping, so the terminator can always be written. The mapping is private
+// and writable, as callers such as next_line() modify the text in place.
+static char *map_file(int fd, size_t size) {
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	size_t len = (size + 2 + page_size - 1) / page_size * page_size;
+	char *p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		return NULL;
+	if (mmap(p, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+		munmap(p, len);
+		return NULL;
+	}
+	p[size] = '\n';
+	p[size + 1] = '\0';
+	return p;
+}
+#endif
+
+// If mtime is not NULL, the modification time of the file is stored in it.
+static char *read_file(const char *path, time_t *mtime) {
 	FILE *fp = checked_fopen(path, "rb");
-	if (fseek(fp, 0, SEEK_END) != 0)
-		error("%s: %s", path, strerror(errno));
-	long size = ftell(fp);
-	if (size < 0)
+	struct stat sbuf;
+	if (fstat(fileno(fp), &sbuf) < 0)
 		error("%s: %s", path, strerror(errno));
-	if (fseek(fp, 0, SEEK_SET) != 0)
-		error("%s: %s", path, strerror(errno));
-	char *buf = malloc(size + 2);
-	if (size > 0 && fread(buf, size, 1, fp) != 1)
-		error("%s: read error", path);
+	if (mtime)
+		*mtime = sbuf.st_mtime;
+
+	char *buf = NULL;
+#ifndef _WIN32
+	// UTF-8 sources are lexed in place, so they need not be copied.
+	if (config.utf8 && !copy_sources && S_ISREG(sbuf.st_mode) && sbuf.st_size > 0)
+		buf = map_file(fileno(fp), sbuf.st_size);
+#endif
+	if (!buf) {
+		if (fseek(fp, 0, SEEK_END) != 0)
+			error("%s: %s", path, strerror(errno));
+		long size = ftell(fp);
+		if (size < 0)
+			error("%s: %s", path, strerror(errno));
+		if (fseek(fp, 0, SEEK_SET) != 0)
+			error("%s: %s", path, strerror(errno));
+		buf = malloc(size + 2);
+		if (size > 0 && fread(buf, size, 1, fp) != 1)
+			error("%s: read error", path);
+		buf[size] = '\n';
+		buf[size + 1] = '\0';
+	}
 	fclose(fp);
-	buf[size] = '\n';
-	buf[size + 1] = '\0';
 
 	if (config.utf8) {
 		const char *err = validate_utf8(buf);
@@ -104,13 +178,18 @@ static char *read_file(const char *path) {
 		}
 		return buf;
 	} else {
-		char *utf = sjis2utf_sub(buf, 0xfffd);  // U+FFFD REPLACEMENT CHARACTER
-		char *err = strstr(utf, "\xef\xbf\xbd");
-		if (err) {
+		const char *invalid;
+		char *utf = sjis2utf_checked(buf, &invalid);
+		if (!utf) {
+			// Show the location in the text converted with U+FFFD REPLACEMENT
+			// CHARACTERs, as the lexer would see it.
+			char *prefix = sjis2utf_sub(strndup_(buf, invalid - buf), 0xfffd);
+			utf = sjis2utf_sub(buf, 0xfffd);
 			lexer_init(utf, path, -1);
-			error_at(err, "Invalid Shift_JIS character");
+			error_at(utf + strlen(prefix), "Invalid Shift_JIS character");
 		}
-		return sjis2utf(buf);
+		free(buf);
+		return utf;
 	}
 }
 
@@ -121,7 +200,7 @@ static char *trim_right(char *str) {
 }
 
 static Vector *read_var_list(const char *path) {
-	char *buf = read_file(path);
+	char *buf = read_file(path, NULL);
 	Vector *vars = new_vec();
 	char *line;
 	while ((line = next_line(&buf)) != NULL)
@@ -129,8 +208,9 @@ static Vector *read_var_list(const char *path) {
 	return vars;
 }
 
-static void read_hed(const char *path, Vector *sources, Map *dlls) {
-	char *buf = read_file(path);
+// If hel_paths is not NULL, the paths of the .hel files read are added to it.
+static void read_hed(const char *path, Vector *sources, Map *dlls, Vector *hel_paths) {
+	char *buf = read_file(path, NULL);
 	char *dir = dirname_utf8(path);
 	enum { INITIAL, SYSTEM35, DLLHeader } section = INITIAL;
 
@@ -168,7 +248,12 @@ static void read_hed(const char *path, Vector *sources, Map *dlls) {
 					*dot = '\0';
 					map_put(dlls, line, new_vec());
 				} else {
-					char *hel_text = read_file(path_join(dir, line));
+					// The path is recorded even if the file cannot be read,
+					// so that --watch notices when it is created.
+					char *hel_path = path_join(dir, line);
+					if (hel_paths)
+						vec_push(hel_paths, hel_path);
+					char *hel_text = read_file(hel_path, NULL);
 					Vector *funcs = parse_hel(hel_text, line);
 					if (dot)
 						*dot = '\0';
@@ -202,34 +287,244 @@ static char *sconame(const char *advname) {
 	return s;
 }
 
-static void build(Vector *src_paths, Vector *variables, Map *dlls, const char *ald_basename, const char *ain_path) {
-	Map *srcs = new_map();
-	for (int i = 0; i < src_paths->len; i++) {
-		char *path = src_paths->data[i];
-		map_put(srcs, path, read_file(path));
+static bool mem_report;
+static bool opt_report;
+static int nr_stripped_functions;
+static int nr_messages;  // before --dedup-messages
+static enum {
+	TIME_REPORT_NONE,
+	TIME_REPORT_TEXT,
+	TIME_REPORT_JSON,
+} time_report;
+
+#define MAX_PHASES 16
+#define NR_SLOWEST_PAGES 10
+
+typedef struct {
+	const char *name;
+	double ms;
+	size_t allocations;  // from arenas
+	size_t bytes;
+} Phase;
+
+static Phase phases[MAX_PHASES];
+static int nr_phases;
+static double phase_start;
+static ArenaStats phase_stats;
+
+static double now_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static void start_phases(void) {
+	nr_phases = 0;
+	phase_start = now_ms();
+	arena_get_stats(&phase_stats);
+}
+
+// Ends a phase of the build that started at the last call (or
+// start_phases()). With --mem-report, prints the memory allocated from arenas
+// in the phase.
+static void end_phase(const char *name) {
+	ArenaStats stats;
+	arena_get_stats(&stats);
+	Phase p = { name, now_ms() - phase_start, stats.count - phase_stats.count, stats.bytes - phase_stats.bytes };
+	if (mem_report)
+		printf("%-12s %10zu allocations %12zu bytes\n", name, p.allocations, p.bytes);
+	if (nr_phases < MAX_PHASES)
+		phases[nr_phases++] = p;
+	phase_stats = stats;
+	phase_start = now_ms();
+}
+
+static void report_memory_total(void) {
+	if (!mem_report)
+		return;
+	ArenaStats stats;
+	arena_get_stats(&stats);
+	printf("%-12s %10zu allocations %12zu bytes\n", "total", stats.count, stats.bytes);
+	printf("peak arena memory: %zu bytes\n", stats.peak_reserved);
+}
+
+static void json_string(const char *s) {
+	putchar('"');
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\')
+			printf("\\%c", *s);
+		else if ((uint8_t)*s < 0x20)
+			printf("\\u%04x", *s);
+		else
+			putchar(*s);
 	}
+	putchar('"');
+}
 
-	Compiler *compiler = new_compiler(srcs->keys, variables, dlls);
+typedef struct {
+	int page;
+	double ms;
+} PageTime;
 
-	if (config.debug)
-		compiler->dbg_info = new_debug_info(srcs);
+static int page_time_compare(const void *a, const void *b) {
+	double d = ((const PageTime *)b)->ms - ((const PageTime *)a)->ms;
+	return d > 0 ? 1 : d < 0 ? -1 : 0;
+}
 
-	for (int i = 0; i < srcs->keys->len; i++) {
-		const char *source = srcs->vals->data[i];
-		preprocess(compiler, source, i);
+// Prints the --time-report. page_ms[i] is the time spent in the second pass
+// of page i, or negative if the page was not compiled. page_ms may be NULL.
+static void report_time(Compiler *compiler, const double *page_ms) {
+	if (time_report == TIME_REPORT_NONE)
+		return;
+
+	int nr_pages = compiler->src_paths->len;
+	PageTime *slowest = calloc(nr_pages + 1, sizeof(PageTime));
+	int nr_slowest = 0;
+	for (int i = 0; page_ms && i < nr_pages; i++) {
+		if (page_ms[i] >= 0)
+			slowest[nr_slowest++] = (PageTime){ i, page_ms[i] };
 	}
+	qsort(slowest, nr_slowest, sizeof(PageTime), page_time_compare);
+	if (nr_slowest > NR_SLOWEST_PAGES)
+		nr_slowest = NR_SLOWEST_PAGES;
 
-	preprocess_done(compiler);
+	int *nr_functions = calloc(nr_pages + 1, sizeof(int));
+	for (HashItem *i = hash_iterate(compiler->functions, NULL); i; i = hash_iterate(compiler->functions, i)) {
+		const Function *func = i->val;
+		if (func->page >= 1 && func->page <= nr_pages)
+			nr_functions[func->page - 1]++;
+	}
+
+	double total = 0;
+	for (int i = 0; i < nr_phases; i++)
+		total += phases[i].ms;
+
+	if (time_report == TIME_REPORT_JSON) {
+		printf("{\n  \"phases\": [");
+		for (int i = 0; i < nr_phases; i++) {
+			Phase *p = &phases[i];
+			printf("%s\n    { \"name\": \"%s\", \"time_ms\": %.3f, \"allocations\": %zu, \"bytes\": %zu }",
+				   i ? "," : "", p->name, p->ms, p->allocations, p->bytes);
+		}
+		printf("\n  ],\n  \"total_ms\": %.3f,\n  \"slowest_pages\": [", total);
+		for (int i = 0; i < nr_slowest; i++) {
+			int page = slowest[i].page;
+			Sco *sco = &compiler->scos[page];
+			printf("%s\n    { \"source\": ", i ? "," : "");
+			json_string(compiler->src_paths->data[page]);
+			printf(", \"time_ms\": %.3f, \"size\": %zu, \"labels\": %d, \"functions\": %d }",
+				   slowest[i].ms, strlen(sco->source), sco->nr_labels, nr_functions[page]);
+		}
+		printf("\n  ]\n}\n");
+	} else {
+		printf("%-12s %10s %12s %12s\n", "phase", "time (ms)", "allocations", "bytes");
+		for (int i = 0; i < nr_phases; i++) {
+			Phase *p = &phases[i];
+			printf("%-12s %10.3f %12zu %12zu\n", p->name, p->ms, p->allocations, p->bytes);
+		}
+		printf("%-12s %10.3f\n", "total", total);
+		if (nr_slowest > 0) {
+			printf("\nslowest pages:\n");
+			printf("%10s %10s %8s %10s  %s\n", "time (ms)", "size", "labels", "functions", "source");
+		}
+		for (int i = 0; i < nr_slowest; i++) {
+			int page = slowest[i].page;
+			Sco *sco = &compiler->scos[page];
+			printf("%10.3f %10zu %8d %10d  %s\n", slowest[i].ms, strlen(sco->source),
+				   sco->nr_labels, nr_functions[page], (char *)compiler->src_paths->data[page]);
+		}
+	}
+	fflush(stdout);
+	free(slowest);
+	free(nr_functions);
+}
+
+// Prints the --opt-report, which shows the effect of the optimizations on
+// the pages compiled in this build.
+static void report_optimization(Compiler *compiler) {
+	if (!opt_report)
+		return;
 
+	if (config.optimize >= 2) {
+		int total_size = 0, total_saved = 0;
+		printf("%10s %10s  %s\n", "size", "saved", "source");
+		for (int i = 0; i < compiler->src_paths->len; i++) {
+			Sco *sco = &compiler->scos[i];
+			total_size += sco->buf->len + sco->bytes_saved;
+			total_saved += sco->bytes_saved;
+			if (sco->bytes_saved)
+				printf("%10d %10d  %s\n", sco->buf->len, sco->bytes_saved, (char *)compiler->src_paths->data[i]);
+		}
+		printf("peephole: %d of %d bytes saved (%.1f%%)\n", total_saved, total_size,
+			   total_size ? total_saved * 100.0 / total_size : 0.0);
+	}
+	if (config.strip_dead) {
+		int nr_stripped = 0;
+		for (int i = 0; i < compiler->src_paths->len; i++) {
+			if (compiler->scos[i].unreachable) {
+				printf("unreachable: %s\n", (char *)compiler->src_paths->data[i]);
+				nr_stripped++;
+			}
+		}
+		for (int i = 0; compiler->unused_functions && i < compiler->unused_functions->len; i++) {
+			Function *func = compiler->unused_functions->data[i];
+			printf("unused function: %s (%s)\n", func->name, (char *)compiler->src_paths->data[func->page - 1]);
+		}
+		printf("strip-dead: %d of %d pages and %d functions removed\n",
+			   nr_stripped, compiler->src_paths->len, nr_stripped_functions);
+	}
+	if (config.dedup_messages && nr_messages > 0) {
+		printf("dedup-messages: %d of %d messages are unique (%.1f%% removed)\n",
+			   compiler->msg_count, nr_messages, (nr_messages - compiler->msg_count) * 100.0 / nr_messages);
+	}
+	fflush(stdout);
+}
+
+typedef struct {
+	Compiler *compiler;
+	Map *srcs;
+	int *pages;  // pages to be compiled
+	double *page_ms;  // time spent in compile() for each page
+} CompileJob;
+
+static void preprocess_page(void *data, int i) {
+	CompileJob *job = data;
+	preprocess(job->compiler, job->srcs->vals->data[i], i);
+}
+
+static void compile_page(void *data, int i) {
+	CompileJob *job = data;
+	int page = job->pages[i];
+	double start = now_ms();
+	compile(job->compiler, job->srcs->vals->data[page], page);
+	job->page_ms[page] = now_ms() - start;
+}
+
+// Returns the timestamp of ALD entries. SOURCE_DATE_EPOCH is honored, and
+// otherwise the modification time of the source file is used (like "ald
+// create" does), so that unchanged sources produce identical ALD files.
+static time_t ald_timestamp(time_t mtime) {
+	const char *epoch = getenv("SOURCE_DATE_EPOCH");
+	if (epoch && *epoch) {
+		char *endptr;
+		errno = 0;
+		long long t = strtoll(epoch, &endptr, 10);
+		if (errno || *endptr || t < 0)
+			error("Invalid SOURCE_DATE_EPOCH '%s'", epoch);
+		return t;
+	}
+	return mtime;
+}
+
+static void write_output(Compiler *compiler, const time_t *timestamps, const char *ald_basename, const char *ain_path, int jobs) {
 	uint32_t ald_mask = 0;
 	Vector *ald = new_vec();
-	for (int i = 0; i < srcs->keys->len; i++) {
-		const char *source = srcs->vals->data[i];
-		Sco *sco = compile(compiler, source, i);
+	for (int i = 0; i < compiler->src_paths->len; i++) {
+		Sco *sco = &compiler->scos[i];
 		AldEntry *e = calloc(1, sizeof(AldEntry));
 		e->volume = sco->ald_volume;
-		e->name = utf2sjis_sub(sconame(basename_utf8(srcs->keys->data[i])), '?');
-		e->timestamp = time(NULL);
+		e->name = utf2sjis_sub(sconame(basename_utf8(compiler->src_paths->data[i])), '?');
+		e->timestamp = timestamps[i];
 		e->data = sco->buf->buf;
 		e->size = sco->buf->len;
 		vec_push(ald, e);
@@ -241,36 +536,565 @@ static void build(Vector *src_paths, Vector *variables, Map *dlls, const char *a
 		FILE *fp = checked_fopen(ain_path, "wb");
 		ain_write(compiler, fp);
 		fclose(fp);
+		end_phase("ain");
 	}
 
+	char *ald_paths[27] = {NULL};
 	for (int i = 1; i <= 26; i++) {
 		if (!(ald_mask & 1 << i))
 			continue;
-		char ald_path[PATH_MAX+1];
-		snprintf(ald_path, sizeof(ald_path), "%sS%c.ALD", ald_basename, 'A' + i - 1);
-		FILE *fp = checked_fopen(ald_path, "wb");
-		ald_write(ald, i, fp);
-		fclose(fp);
+		ald_paths[i] = malloc(PATH_MAX + 1);
+		snprintf(ald_paths[i], PATH_MAX + 1, "%sS%c.ALD", ald_basename, 'A' + i - 1);
 	}
+	ald_write_volumes(ald, ald_paths, jobs);
+	end_phase("ald");
 
 	if (config.debug) {
 		char symbols_path[PATH_MAX+1];
 		snprintf(symbols_path, sizeof(symbols_path), "%sSA.ALD.symbols", ald_basename);
 		FILE *fp = checked_fopen(symbols_path, "wb");
-		debug_info_write(compiler->dbg_info, compiler, fp);
+		debug_info_write(compiler->dbg_info, compiler, fp, jobs);
 		fclose(fp);
+		end_phase("debug");
+	}
+}
+
+// Compiles the preprocessed pages of compiler and writes the output.
+static void finish_build(Compiler *compiler, Map *srcs, time_t *mtimes, const char *ald_basename, const char *ain_path, struct BuildCache *cache, int jobs) {
+	if (config.debug)
+		compiler->dbg_info = new_debug_info(srcs);
+
+	preprocess_done(compiler);
+	end_phase("preprocess");
+
+	int nr_srcs = srcs->keys->len;
+	CompileJob job = { compiler, srcs, calloc(nr_srcs, sizeof(int)), malloc(nr_srcs * sizeof(double)) };
+	for (int i = 0; i < nr_srcs; i++)
+		job.page_ms[i] = -1;
+	if (cache)
+		cache_set_project(cache, compiler);
+	int nr_pages = 0;
+	for (int i = 0; i < srcs->keys->len; i++) {
+		if (!cache || !cache_load(cache, compiler, i))
+			job.pages[nr_pages++] = i;
+	}
+
+	parallel_for(nr_pages, jobs, compile_page, &job);
+
+	if (cache) {
+		for (int i = 0; i < nr_pages; i++)
+			cache_store(cache, compiler, job.pages[i]);
+	}
+
+	end_phase("compile");
+
+	for (int i = 0; i < nr_srcs; i++)
+		mtimes[i] = ald_timestamp(mtimes[i]);
+
+	if (config.strip_dead)
+		nr_stripped_functions = strip_dead_code(compiler);
+	nr_messages = compiler->msg_count;
+	compile_done(compiler);
+	end_phase("link");
+	write_output(compiler, mtimes, ald_basename, ain_path, jobs);
+	report_memory_total();
+	report_time(compiler, job.page_ms);
+	report_optimization(compiler);
+}
+
+static void build(Vector *src_paths, Vector *variables, Map *dlls, const char *ald_basename, const char *ain_path, const char *cache_dir, int jobs) {
+	start_phases();
+	Map *srcs = new_map();
+	time_t *mtimes = calloc(src_paths->len, sizeof(time_t));
+	for (int i = 0; i < src_paths->len; i++) {
+		char *path = src_paths->data[i];
+		map_put(srcs, path, read_file(path, &mtimes[i]));
+	}
+	end_phase("read");
+
+	Compiler *compiler = new_compiler(srcs->keys, variables, dlls);
+
+	CompileJob job = { compiler, srcs, NULL, NULL };
+	parallel_for(srcs->keys->len, jobs, preprocess_page, &job);
+
+	struct BuildCache *cache = cache_dir ? new_build_cache(cache_dir) : NULL;
+	finish_build(compiler, srcs, mtimes, ald_basename, ain_path, cache, jobs);
+}
+
+#ifndef _WIN32
+
+// Compile server (--serve). The server listens on a Unix domain socket and
+// keeps the project configuration, the .hed/.hel definitions, the variables
+// list, the transcoded sources and the first-pass result of each page in
+// memory. A client sends one command per connection:
+//
+//   rebuild  Rebuilds the project. The reply is the compiler messages,
+//            followed by a line "ok" or "error".
+//   quit     Stops the server.
+//
+// On rebuild, only files whose size, modification time or inode has changed
+// are read again, and only their pages are preprocessed. The rest of the
+// build runs in a forked child process, so that an error or the memory it
+// allocates does not affect the server. Compiled pages are cached (in memory,
+// unless --cache-dir is given), so unchanged pages are not compiled again.
+
+typedef struct {
+	const char *path;
+	struct timespec mtime;
+	off_t size;
+	ino_t ino;
+} FileStamp;
+
+static FileStamp *stamp_file(const char *path) {
+	struct stat sbuf;
+	if (stat(path, &sbuf) < 0)
+		error("%s: %s", path, strerror(errno));
+	FileStamp *st = calloc(1, sizeof(FileStamp));
+	st->path = path;
+	st->mtime = sbuf.st_mtim;
+	st->size = sbuf.st_size;
+	st->ino = sbuf.st_ino;
+	return st;
+}
+
+static bool file_changed(const FileStamp *st) {
+	struct stat sbuf;
+	return stat(st->path, &sbuf) < 0 ||
+		sbuf.st_mtim.tv_sec != st->mtime.tv_sec ||
+		sbuf.st_mtim.tv_nsec != st->mtime.tv_nsec ||
+		sbuf.st_size != st->size ||
+		sbuf.st_ino != st->ino;
+}
+
+typedef struct {
+	FileStamp *stamp;
+	char *text;  // in UTF-8, on the heap
+} Source;
+
+typedef struct {
+	Compiler *compiler;
+	const char *source;
+	int page;
+	bool ok;
+} PreprocessTask;
+
+typedef struct {
+	const char *hed;
+	const char *var_list;
+	Vector *args;  // source files given on the command line
+	const char *ald_basename;
+	const char *ain_path;
+	int jobs;
+	int listen_fd;
+
+	Vector *inputs;  // FileStamps of the .hed, .hel and variables files
+	Vector *hel_paths;  // including the ones that could not be read
+	Compiler *compiler;  // holds the result of preprocess() for each page
+	HashMap *sources;  // path -> Source
+	PreprocessTask *tasks;  // reused, as refresh() may fail after allocating it
+	struct BuildCache *cache;
+} Server;
+
+static void run_preprocess_task(void *data) {
+	PreprocessTask *task = data;
+	preprocess(task->compiler, task->source, task->page);
+}
+
+// The threads of parallel_for() exit when it returns, and an error leaves
+// the scratch arena in use, so it is freed after each page.
+static void preprocess_task(void *data, int i) {
+	PreprocessTask *task = (PreprocessTask *)data + i;
+	task->ok = catch_error(run_preprocess_task, task);
+	free_scratch_arena();
+}
+
+static void reload_inputs(Server *s) {
+	Vector *inputs = new_vec();
+	Vector *src_paths = new_vec();
+	Map *dlls = new_map();
+	if (s->hed) {
+		vec_push(inputs, stamp_file(s->hed));
+		s->hel_paths = new_vec();
+		read_hed(s->hed, src_paths, dlls, s->hel_paths);
+		for (int i = 0; i < s->hel_paths->len; i++)
+			vec_push(inputs, stamp_file(s->hel_paths->data[i]));
+	}
+	for (int i = 0; i < s->args->len; i++)
+		vec_push(src_paths, s->args->data[i]);
+	if (src_paths->len == 0)
+		error("xsys35c: No source file specified.");
+
+	Vector *vars = NULL;
+	if (s->var_list) {
+		vec_push(inputs, stamp_file(s->var_list));
+		vars = read_var_list(s->var_list);
+	}
+
+	if (s->inputs) {
+		for (int i = 0; i < s->inputs->len; i++)
+			free(s->inputs->data[i]);
+		free_vec(s->inputs);
+	}
+	s->inputs = inputs;
+	if (s->compiler)
+		free_compiler(s->compiler);
+	s->compiler = new_compiler(src_paths, vars, dlls);
+}
+
+// Brings the in-memory state up to date with the files. This is called
+// through catch_error(); if it fails, the pages that could not be read or
+// preprocessed are retried on the next call.
+static void refresh(void *data) {
+	Server *s = data;
+	bool reload = !s->compiler;
+	for (int i = 0; !reload && i < s->inputs->len; i++)
+		reload = file_changed(s->inputs->data[i]);
+	if (reload)
+		reload_inputs(s);
+
+	Compiler *compiler = s->compiler;
+	int nr_pages = compiler->src_paths->len;
+	PreprocessTask *tasks = s->tasks = realloc(s->tasks, nr_pages * sizeof(PreprocessTask));
+	int nr_tasks = 0;
+	for (int i = 0; i < nr_pages; i++) {
+		const char *path = compiler->src_paths->data[i];
+		Source *src = hash_get(s->sources, path);
+		if (!src || file_changed(src->stamp)) {
+			FileStamp *stamp = stamp_file(path);
+			char *text = read_file(path, NULL);
+			if (src) {
+				free(src->stamp);
+				free(src->text);
+			} else {
+				src = calloc(1, sizeof(Source));
+				hash_put(s->sources, path, src);
+			}
+			src->stamp = stamp;
+			src->text = text;
+			// The new text may have the address of the old one.
+			compiler->scos[i].source = NULL;
+		}
+
+		if (compiler->scos[i].source == src->text)
+			continue;
+		reset_page(compiler, i);
+		tasks[nr_tasks++] = (PreprocessTask){ compiler, src->text, i, false };
+	}
+
+	parallel_for(nr_tasks, s->jobs, preprocess_task, tasks);
+	for (int i = 0; i < nr_tasks; i++) {
+		if (!tasks[i].ok)
+			error_exit();
+	}
+}
+
+// Runs the rest of the build in a child process. Returns true if it succeeds.
+static bool run_build(Server *s) {
+	int fds[2];
+	if (pipe(fds) < 0) {
+		fprintf(stderr, "pipe: %s\n", strerror(errno));
+		return false;
+	}
+	fflush(stdout);
+	fflush(stderr);
+	pid_t pid = fork();
+	if (pid < 0) {
+		fprintf(stderr, "fork: %s\n", strerror(errno));
+		close(fds[0]);
+		close(fds[1]);
+		return false;
 	}
+	if (pid == 0) {
+		close(fds[0]);
+		if (s->listen_fd >= 0)
+			close(s->listen_fd);
+		Compiler *compiler = s->compiler;
+		int nr_pages = compiler->src_paths->len;
+		Map *srcs = new_map();
+		time_t *mtimes = calloc(nr_pages, sizeof(time_t));
+		for (int i = 0; i < nr_pages; i++) {
+			const char *path = compiler->src_paths->data[i];
+			Source *src = hash_get(s->sources, path);
+			map_put(srcs, path, src->text);
+			mtimes[i] = src->stamp->mtime.tv_sec;
+		}
+		start_phases();
+		finish_build(compiler, srcs, mtimes, s->ald_basename, s->ain_path, s->cache, s->jobs);
+		cache_send(s->cache, fds[1]);
+		exit(0);
+	}
+
+	close(fds[1]);
+	cache_receive(s->cache, fds[0]);
+	close(fds[0]);
+	int status;
+	while (waitpid(pid, &status, 0) < 0) {
+		if (errno != EINTR)
+			return false;
+	}
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static bool rebuild(Server *s) {
+	return catch_error(refresh, s) && run_build(s);
+}
+
+static void init_server(Server *s, const char *cache_dir) {
+	copy_sources = true;
+	s->sources = new_string_hash();
+	s->cache = new_build_cache(cache_dir);
+	// Warm up. Errors are reported again on the first rebuild.
+	catch_error(refresh, s);
+}
+
+static void read_command(int fd, char *buf, size_t size) {
+	size_t len = 0;
+	while (len < size - 1) {
+		ssize_t n = read(fd, buf + len, 1);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0 || buf[len] == '\n')
+			break;
+		len++;
+	}
+	buf[len] = '\0';
+	trim_right(buf);
 }
 
+// Returns false if the server should stop.
+static bool handle_client(Server *s, int fd) {
+	char command[64];
+	read_command(fd, command, sizeof(command));
+
+	// Send the messages to the client.
+	fflush(stdout);
+	fflush(stderr);
+	int saved_stdout = dup(STDOUT_FILENO);
+	int saved_stderr = dup(STDERR_FILENO);
+	dup2(fd, STDOUT_FILENO);
+	dup2(fd, STDERR_FILENO);
+
+	bool keep_running = true;
+	if (!strcmp(command, "rebuild")) {
+		puts(rebuild(s) ? "ok" : "error");
+	} else if (!strcmp(command, "quit")) {
+		keep_running = false;
+	} else {
+		printf("unknown command '%s'\nerror\n", command);
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+	dup2(saved_stdout, STDOUT_FILENO);
+	dup2(saved_stderr, STDERR_FILENO);
+	close(saved_stdout);
+	close(saved_stderr);
+	return keep_running;
+}
+
+static void serve(const char *socket_path, Server *s, const char *cache_dir) {
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	if (strlen(socket_path) >= sizeof(addr.sun_path))
+		error("%s: socket path too long", socket_path);
+	strcpy(addr.sun_path, socket_path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		error("socket: %s", strerror(errno));
+	// Replace a socket left by a server that is no longer running.
+	struct stat sbuf;
+	if (lstat(socket_path, &sbuf) == 0 && S_ISSOCK(sbuf.st_mode)) {
+		if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+			error("%s: another server is running", socket_path);
+		unlink(socket_path);
+	}
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 8) < 0)
+		error("%s: %s", socket_path, strerror(errno));
+	// Do not die when a client goes away.
+	signal(SIGPIPE, SIG_IGN);
+
+	s->listen_fd = fd;
+	init_server(s, cache_dir);
+
+	for (;;) {
+		int client = accept(fd, NULL, NULL);
+		if (client < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			error("accept: %s", strerror(errno));
+		}
+		bool keep_running = handle_client(s, client);
+		close(client);
+		if (!keep_running)
+			break;
+	}
+	close(fd);
+	unlink(socket_path);
+}
+
+#ifdef __linux__
+
+// Watch mode (--watch). The project is rebuilt as in the compile server
+// whenever one of its input files is written. The directories containing the
+// inputs are watched rather than the files themselves, so that files replaced
+// by rename (as many editors save them) are noticed too.
+
+// Events arriving within this period after the previous one are handled by a
+// single rebuild, as editors may write several files in quick succession.
+#define WATCH_SETTLE_MS 20
+
+enum {
+	INPUT_CHANGED = 1,
+	CONFIG_CHANGED = 2,
+};
+
+typedef struct {
+	int wd;
+	Vector *names;  // basenames of the watched files in the directory
+} WatchedDir;
+
+static void add_watch(int fd, Vector *dirs, const char *path) {
+	char *dirname = dirname_utf8(path);
+	int wd = inotify_add_watch(fd, dirname, IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM);
+	if (wd < 0) {
+		fprintf(stderr, "Warning: cannot watch %s: %s\n", dirname, strerror(errno));
+		return;
+	}
+	WatchedDir *dir = NULL;
+	for (int i = 0; i < dirs->len && !dir; i++) {
+		if (((WatchedDir *)dirs->data[i])->wd == wd)
+			dir = dirs->data[i];
+	}
+	if (!dir) {
+		dir = calloc(1, sizeof(WatchedDir));
+		dir->wd = wd;
+		dir->names = new_vec();
+		vec_push(dirs, dir);
+	}
+	vec_push(dir->names, basename_utf8(path));
+}
+
+static bool is_watched(Vector *dirs, const struct inotify_event *ev) {
+	for (int i = 0; i < dirs->len; i++) {
+		WatchedDir *dir = dirs->data[i];
+		if (dir->wd != ev->wd)
+			continue;
+		for (int j = 0; j < dir->names->len; j++) {
+			if (!strcmp(dir->names->data[j], ev->name))
+				return true;
+		}
+	}
+	return false;
+}
+
+// Waits until a file in inputs or configs changes, and returns a mask of
+// INPUT_CHANGED and CONFIG_CHANGED.
+static int wait_for_changes(int fd, Vector *inputs, Vector *configs) {
+	int changes = 0;
+	int timeout = -1;
+	for (;;) {
+		struct pollfd pfd = { .fd = fd, .events = POLLIN };
+		int r = poll(&pfd, 1, timeout);
+		if (r == 0)
+			return changes;
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			error("poll: %s", strerror(errno));
+		}
+
+		char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+		ssize_t len = read(fd, buf, sizeof(buf));
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			error("inotify: %s", strerror(errno));
+		}
+		const struct inotify_event *ev;
+		for (char *p = buf; p < buf + len; p += sizeof(struct inotify_event) + ev->len) {
+			ev = (const struct inotify_event *)p;
+			if (!ev->len)
+				continue;
+			if (is_watched(inputs, ev))
+				changes |= INPUT_CHANGED;
+			if (is_watched(configs, ev))
+				changes |= CONFIG_CHANGED;
+		}
+		if (changes)
+			timeout = WATCH_SETTLE_MS;
+	}
+}
+
+// argv is the original command line, used to restart xsys35c when the
+// configuration file changes.
+static void watch(Server *s, const char *cache_dir, const char *config_path, char **argv) {
+	int fd = inotify_init1(IN_CLOEXEC);
+	if (fd < 0)
+		error("inotify_init1: %s", strerror(errno));
+	s->listen_fd = -1;
+	init_server(s, cache_dir);
+
+	// The set of sources depends on the .hed file, so a change to the files
+	// that define the project restarts xsys35c like a change to the
+	// configuration file does, and the watched set never changes.
+	Vector *inputs = new_vec();
+	Vector *configs = new_vec();
+	if (config_path)
+		add_watch(fd, configs, config_path);
+	if (s->hed)
+		add_watch(fd, configs, s->hed);
+	if (s->var_list)
+		add_watch(fd, configs, s->var_list);
+	// The .hel files are known even if the first load failed, unless the
+	// .hed file itself is broken; fixing it restarts xsys35c.
+	for (int i = 0; s->hel_paths && i < s->hel_paths->len; i++)
+		add_watch(fd, configs, s->hel_paths->data[i]);
+	for (int i = 0; s->compiler && i < s->compiler->src_paths->len; i++)
+		add_watch(fd, inputs, s->compiler->src_paths->data[i]);
+
+	for (;;) {
+		struct timespec start, end;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		bool ok = rebuild(s);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		if (ok) {
+			long ms = (end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000;
+			printf("xsys35c: build finished in %ld ms\n", ms);
+		} else {
+			puts("xsys35c: build failed");
+		}
+		fflush(stdout);
+
+		if (wait_for_changes(fd, inputs, configs) & CONFIG_CHANGED) {
+			puts("xsys35c: configuration changed, restarting");
+			fflush(stdout);
+			execv("/proc/self/exe", argv);
+			fprintf(stderr, "cannot restart xsys35c: %s\n", strerror(errno));
+		}
+	}
+}
+
+#endif  // __linux__
+
+#endif  // !_WIN32
+
 int main(int argc, char *argv[]) {
 	init(&argc, &argv);
+	// getopt_long() permutes argv.
+	char **orig_argv = calloc(argc + 1, sizeof(char *));
+	memcpy(orig_argv, argv, argc * sizeof(char *));
 
 	const char *project = NULL;
+	const char *config_path = NULL;
 	const char *ald_basename = NULL;
 	const char *output_ain = NULL;
 	const char *hed = NULL;
 	const char *var_list = NULL;
+	const char *cache_dir = NULL;
+	const char *socket_path = NULL;
+	bool watch_mode = false;
 	bool init_mode = false;
+	int jobs = 1;
 
 	int opt;
 	while ((opt = getopt_long(argc, argv, short_options, long_options, NULL)) != -1) {
@@ -278,6 +1102,9 @@ int main(int argc, char *argv[]) {
 		case 'a':
 			output_ain = optarg;
 			break;
+		case 'c':
+			cache_dir = optarg;
+			break;
 		case 'E':
 			switch (optarg[0]) {
 			case 's': case 'S': config.utf8 = false; break;
@@ -297,21 +1124,60 @@ int main(int argc, char *argv[]) {
 		case 'I':
 			init_mode = true;
 			break;
+		case 'j':
+			jobs = atoi(optarg);
+			if (jobs <= 0)
+				error("Invalid number of jobs '%s'", optarg);
+			break;
+		case 'M':
+			mem_report = true;
+			break;
+		case 'T':
+			if (!optarg)
+				time_report = TIME_REPORT_TEXT;
+			else if (!strcmp(optarg, "json"))
+				time_report = TIME_REPORT_JSON;
+			else
+				error("Unknown time report format '%s'", optarg);
+			break;
 		case 'o':
 			ald_basename = optarg;
 			break;
+		case 'O':
+			if (!optarg)
+				config.optimize = 1;
+			else if (!strcmp(optarg, "0") || !strcmp(optarg, "1") || !strcmp(optarg, "2"))
+				config.optimize = optarg[0] - '0';
+			else
+				error("Invalid optimization level '%s'", optarg);
+			break;
+		case 'R':
+			opt_report = true;
+			break;
+		case 'D':
+			config.strip_dead = true;
+			break;
+		case 'U':
+			config.dedup_messages = true;
+			break;
 		case 'p':
 			project = optarg;
 			break;
 		case 's':
 			set_sys_ver(optarg);
 			break;
+		case 'S':
+			socket_path = optarg;
+			break;
 		case 'u':
 			config.unicode = true;
 			break;
 		case 'V':
 			var_list = optarg;
 			break;
+		case 'W':
+			watch_mode = true;
+			break;
 		case 'v':
 			version();
 			return 0;
@@ -330,11 +1196,13 @@ int main(int argc, char *argv[]) {
 		FILE *fp = checked_fopen(project, "r");
 		load_config(fp, dirname_utf8(project));
 		fclose(fp);
+		config_path = project;
 	} else if (!hed && argc == 0) {
 		FILE *fp = fopen("xsys35c.cfg", "r");
 		if (fp) {
 			load_config(fp, NULL);
 			fclose(fp);
+			config_path = "xsys35c.cfg";
 		} else {
 			usage();
 			return 1;
@@ -355,10 +1223,39 @@ int main(int argc, char *argv[]) {
 			: DEFAULT_OUTPUT_AIN;
 	}
 
+	if (socket_path || watch_mode) {
+		if (socket_path && watch_mode)
+			error("xsys35c: --serve and --watch cannot be used together");
+#ifdef _WIN32
+		error("xsys35c: --%s is not supported on this platform", socket_path ? "serve" : "watch");
+#else
+		Server server = {
+			.hed = hed,
+			.var_list = var_list,
+			.args = new_vec(),
+			.ald_basename = ald_basename,
+			.ain_path = output_ain,
+			.jobs = jobs,
+		};
+		for (int i = 0; i < argc; i++)
+			vec_push(server.args, argv[i]);
+		if (socket_path)
+			serve(socket_path, &server, cache_dir);
+#ifdef __linux__
+		else
+			watch(&server, cache_dir, config_path, orig_argv);
+#else
+		else
+			error("xsys35c: --watch is not supported on this platform");
+#endif
+		return 0;
+#endif
+	}
+
 	Vector *srcs = new_vec();
 	Map *dlls = new_map();
 	if (hed)
-		read_hed(hed, srcs, dlls);
+		read_hed(hed, srcs, dlls, NULL);
 
 	for (int i = 0; i < argc; i++)
 		vec_push(srcs, argv[i]);
@@ -368,6 +1265,6 @@ int main(int argc, char *argv[]) {
 
 	Vector *vars = var_list ? read_var_list(var_list) : NULL;
 
-	build(srcs, vars, dlls, ald_basename, output_ain);
+	build(srcs, vars, dlls, ald_basename, output_ain, cache_dir, jobs);
 	return 0;
 }
@@ -19,23 +19,22 @@
 
 // config.c
 
-typedef enum {
-	SYSTEM35,
-	SYSTEM36,
-	SYSTEM38,
-	SYSTEM39,
-} SysVer;
-
 typedef struct {
 	const char *ald_basename;
 	const char *output_ain;
 	uint32_t ain_version;
+	uint32_t dsym_version;
 
 	SysVer sys_ver;
 	ScoVer sco_ver;
 	const char *hed;
 	const char *var_list;
 
+	int optimize;  // optimization level (-O)
+	bool strip_dead;
+	Vector *exports;  // functions called by name from outside the scenario
+	bool dedup_messages;
+
 	bool debug;
 	bool unicode;
 	bool utf8;
@@ -70,6 +69,8 @@ void emit(Buffer *b, uint8_t c);
 void emit_word(Buffer *b, uint16_t v);
 void emit_word_be(Buffer *b, uint16_t v);
 void emit_dword(Buffer *b, uint32_t v);
+uint8_t *emit_reserve(Buffer *b, int len);
+void emit_data(Buffer *b, const void *data, int len);
 void emit_string(Buffer *b, const char *s);
 void set_byte(Buffer *b, uint32_t addr, uint8_t val);
 uint8_t get_byte(Buffer *b, uint32_t addr);
@@ -84,13 +85,15 @@ void sco_finalize(Buffer *b);
 
 // lexer.c
 
-extern const char *input_name;
-extern int input_page;
-extern const char *input_buf;
-extern const char *input;
-extern int input_line;
+extern _Thread_local const char *input_name;
+extern _Thread_local int input_page;
+extern _Thread_local const char *input_buf;
+extern _Thread_local const char *input;
+extern _Thread_local int input_line;
+extern _Thread_local Arena *lexer_arena;  // for strings returned by get_*()
+extern _Thread_local Interner *lexer_names;
 
-#define error_at(...) (warn_at(__VA_ARGS__), exit(1))
+#define error_at(...) (warn_at(__VA_ARGS__), error_exit())
 void warn_at(const char *pos, char *fmt, ...);
 void lexer_init(const char *source, const char *name, int pageno);
 void skip_whitespaces(void);
@@ -108,8 +111,29 @@ void compile_message(Buffer *b);
 void compile_bare_string(Buffer *b);
 int get_command(Buffer *b);
 
+// scan.c
+
+// Skips ' ', '\t', '\r' and '\n', and sets *newlines to the number of '\n's
+// skipped.
+const char *scan_blanks(const char *p, int *newlines);
+// Returns the first ASCII character (including '\0') at or after p.
+const char *scan_non_ascii(const char *p);
+// Returns the first control character, non-ASCII byte, c1, c2 or c3 at or
+// after p.
+const char *scan_ascii(const char *p, char c1, char c2, char c3);
+
 // compile.c
 
+typedef enum {
+	VARIABLE,
+	CONST,
+} SymbolType;
+
+typedef struct {
+	SymbolType type;
+	int value;  // variable index or constant value
+} Symbol;
+
 typedef struct {
 	const char *name;
 	bool resolved;
@@ -118,9 +142,29 @@ typedef struct {
 	Vector *params;
 } Function;
 
+// A reference to a function. References to functions defined in other pages
+// are resolved after all pages are compiled.
+typedef struct {
+	uint32_t addr;  // address of the (page, addr) operand
+	Function *func;
+} FuncRef;
+
 typedef struct {
+	Arena *arena;  // for objects that live as long as the compiler
+	const char *source;
+	Vector *definitions;  // symbols defined in this page, collected in the first pass
 	Buffer *buf;
 	int ald_volume;
+	Vector *func_refs;  // FuncRefs
+	Buffer *msg_buf;  // messages for System39.ain
+	int msg_start;  // ID of the first message in this page
+	int msg_count;
+	int nr_labels;  // for --time-report
+	int bytes_saved;  // by the peephole optimizer, for --opt-report
+	Vector *msg_refs;  // addresses of message IDs
+	Vector *page_refs;  // pages jumped to or called by constant page numbers
+	bool dynamic_page_refs;  // page jumps or function calls not known at compile time
+	bool unreachable;  // stubbed out by --strip-dead
 } Sco;
 
 struct DebugInfo;
@@ -128,6 +172,7 @@ struct DebugInfo;
 typedef struct {
 	Vector *src_paths;
 	Vector *variables;
+	Interner *names;  // keys of symbols and functions
 	HashMap *symbols;   // variables and constants
 	HashMap *functions;
 	Map *dlls;
@@ -135,9 +180,12 @@ typedef struct {
 	int msg_count;
 	Sco *scos;
 	struct DebugInfo *dbg_info;
+	Arena *arena;  // for objects created outside of per-page processing
+	Vector *unused_functions;  // removed from reachable pages by --strip-dead
 } Compiler;
 
 typedef struct {
+	const char *name;
 	uint32_t addr;
 	uint32_t hole_addr;
 	const char *source_loc;
@@ -145,9 +193,37 @@ typedef struct {
 } Label;
 
 Compiler *new_compiler(Vector *src_paths, Vector *variables, Map *dlls);
+void free_compiler(Compiler *comp);
+void reset_page(Compiler *comp, int pageno);
+void free_scratch_arena(void);
 void preprocess(Compiler *comp, const char *source, int pageno);
 void preprocess_done(Compiler *comp);
 Sco *compile(Compiler *comp, const char *source, int pageno);
+void compile_done(Compiler *comp);
+
+// strip.c
+
+int strip_dead_code(Compiler *comp);
+
+// cache.c
+
+struct BuildCache;
+struct BuildCache *new_build_cache(const char *dir);  // in memory if dir is NULL
+void cache_set_project(struct BuildCache *cache, Compiler *compiler);
+bool cache_load(struct BuildCache *cache, Compiler *compiler, int page);
+void cache_store(struct BuildCache *cache, Compiler *compiler, int page);
+void cache_send(struct BuildCache *cache, int fd);
+void cache_receive(struct BuildCache *cache, int fd);
+
+// object.c
+
+#define HASH64_INIT 14695981039346656037ULL
+uint64_t hash64(uint64_t h, const void *data, size_t len);
+uint64_t project_hash(Compiler *compiler);
+void write_object_file(const char *path, const char *magic, uint64_t key, Buffer *payload);
+const uint8_t *read_object_file(const char *path, const char *magic, uint64_t *key);
+void object_save_page(Compiler *compiler, int page, Buffer *out);
+bool object_load_page(Compiler *compiler, int page, const uint8_t *p);
 
 // ain.c
 
@@ -157,11 +233,36 @@ void ain_write(Compiler *compiler, FILE *fp);
 
 Vector *parse_hel(const char* hel, const char *name);
 
+// peephole.c
+
+typedef struct Peephole Peephole;
+Peephole *new_peephole(void);
+void free_peephole(Peephole *p);
+// The dword at addr is an address in the page. If branch is true, it is the
+// destination of a jump or call.
+void peephole_addr(Peephole *p, int addr, bool branch);
+// There is an '@' instruction at addr.
+void peephole_jump(Peephole *p, int addr);
+// There is a '{' instruction in [start, end).
+void peephole_cond(Peephole *p, int start, int end);
+// The instruction in [start, end) has no effect.
+void peephole_nop(Peephole *p, int start, int end);
+// The code at or after addr has been discarded.
+void peephole_truncate(Peephole *p, int addr);
+// Optimizes the code in buf. Returns an array that maps the old addresses
+// (up to buf->len inclusive) to the new ones, which the caller must free.
+int *peephole_run(Peephole *p, Buffer *buf);
+
 // debuginfo.c
 
 struct DebugInfo *new_debug_info(Map *srcs);
 void debug_init_page(struct DebugInfo *di, int page);
-void debug_line_add(struct DebugInfo *di, int line, int addr);
-void debug_line_reset(struct DebugInfo *di);
-void debug_finish_page(struct DebugInfo *di, Map *labels);
-void debug_info_write(struct DebugInfo *di, Compiler *compiler, FILE *fp);
+void debug_line_add(struct DebugInfo *di, int page, int line, int addr);
+void debug_line_reset(struct DebugInfo *di, int page);
+void debug_line_relocate(struct DebugInfo *di, int page, const int *addr_map);
+void debug_line_truncate(struct DebugInfo *di, int page, int addr);
+void debug_clear_page(struct DebugInfo *di, int page);
+void debug_finish_page(struct DebugInfo *di, int page, Vector *labels);
+void debug_save_page(struct DebugInfo *di, int page, Buffer *out);
+const uint8_t *debug_load_page(struct DebugInfo *di, int page, const uint8_t *p);
+void debug_info_write(struct DebugInfo *di, Compiler *compiler, FILE *fp, int jobs);
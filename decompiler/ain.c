@@ -18,9 +18,18 @@
 #include "xsys35dc.h"
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef _POSIX_MAPPED_FILES
+#include <sys/mman.h>
+#endif
+#ifndef _O_BINARY
+#define _O_BINARY 0
+#endif
 
 static uint8_t *input;
 
@@ -110,29 +119,44 @@ HashMap *new_function_hash(void) {
 }
 
 Ain *ain_read(const char *path) {
-	FILE *fp = checked_fopen(path, "rb");
-	if (fseek(fp, 0, SEEK_END) != 0)
-		error("%s: %s", path, strerror(errno));
-	long size = ftell(fp);
-	if (size < 0)
-		error("%s: %s", path, strerror(errno));
-	if (fseek(fp, 0, SEEK_SET) != 0)
+	int fd = checked_open(path, O_RDONLY | _O_BINARY);
+	struct stat sbuf;
+	if (fstat(fd, &sbuf) < 0)
 		error("%s: %s", path, strerror(errno));
+	size_t size = sbuf.st_size;
+	if (size < 8)
+		error("%s: not an AIN file", path);
+
+	// Decrypt into a single allocation, which the strings in the returned Ain
+	// point into. The header is not encrypted.
 	input = malloc(size);
+	if (!input)
+		error("cannot read %s: out of memory", path);
 	const uint8_t *input_end = input + size;
-	if (fread(input, size, 1, fp) != 1)
-		error("%s: read error", path);
-	fclose(fp);
+#ifdef _POSIX_MAPPED_FILES
+	uint8_t *p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (p == MAP_FAILED)
+		error("%s: %s", path, strerror(errno));
+	memcpy(input, p, 8);
+	ain_decrypt(input + 8, p + 8, size - 8);
+	munmap(p, size);
+#else
+	size_t bytes = 0;
+	while (bytes < size) {
+		ssize_t ret = read(fd, input + bytes, size - bytes);
+		if (ret <= 0)
+			error("%s: %s", path, strerror(errno));
+		bytes += ret;
+	}
+	ain_decrypt(input + 8, input + 8, size - 8);
+#endif
+	close(fd);
 
 	uint32_t version = le32(input + 4);
 	if ((version == 1 && memcmp(input, "AINI", 4)) ||
 		(version == 2 && memcmp(input, "AIN2", 4)))
 		error("%s: not an AIN file", path);
 
-	// Decrypt
-	for (uint8_t *p = input + 4; p < input_end; p++)
-		*p = *p << 2 | *p >> 6;
-
 	Ain *ain = calloc(1, sizeof(Ain));
 	ain->filename = basename_utf8(path);
 	ain->version = version;
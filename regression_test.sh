@@ -19,6 +19,16 @@ rm -rf testdata/decompiled
 ${bindir}/xsys35dc -o testdata/decompiled testdata/actualSA.ALD
 diff -uN --strip-trailing-cr testdata/source testdata/decompiled
 
+# Code optimized with -O2 does not match the source, but it must decompile to
+# a source that compiles to the same code.
+for src in source optimize; do
+    ${bindir}/xsys35c -p testdata/${src}/xsys35c.cfg -O2 -o testdata/optimized
+    rm -rf testdata/decompiled_O2
+    ${bindir}/xsys35dc -o testdata/decompiled_O2 testdata/optimizedSA.ALD
+    ${bindir}/xsys35c -p testdata/decompiled_O2/xsys35c.cfg -o testdata/recompiled
+    ${bindir}/ald compare testdata/optimizedSA.ALD testdata/recompiledSA.ALD
+done
+
 
 tmpfile=$(mktemp)
 
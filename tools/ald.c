@@ -227,14 +227,17 @@ static int do_create(int argc, char *argv[]) {
 		char base = *volume_letter - 1;
 
 		uint32_t vol_bits = add_files_from_manifest(entries, manifest);
+		char *paths[27] = {NULL};
+		int nr_volumes = 0;
 		for (int vol = 1; vol <= 26; vol++) {
 			if ((vol_bits & 1 << vol) == 0)
 				continue;
 			*volume_letter = base + vol;
-			FILE *fp = checked_fopen(ald_path, "wb");
-			ald_write(entries, vol, fp);
-			fclose(fp);
+			paths[vol] = strdup(ald_path);
+			nr_volumes++;
 		}
+		// Writing is mostly I/O bound, so write all volumes at once.
+		ald_write_volumes(entries, paths, nr_volumes);
 	} else {
 		for (int i = 1; i < argc; i++)
 			add_file(entries, 1, i, argv[i]);
@@ -0,0 +1,262 @@
+/* Copyright (C) 2026 <KichikuouChrome@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+*/
+
+// Generates a synthetic System 3.9 project for benchmarks (see
+// benchmark.sh). The output depends only on the options, so a project can be
+// regenerated anywhere to reproduce a measurement.
+//
+// Each page consists of a number of labeled blocks of statements, followed by
+// the functions defined in the page. The statements are messages, DLL calls,
+// assignments, conditional jumps to labels in the same page, and calls to
+// functions in any page.
+
+#include "common.h"
+#include <getopt.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BLOCK_STATEMENTS 8
+#define NR_VARIABLES 16
+#define NR_DLL_FUNCS 4
+#define DLL_NAME "Bench"
+
+static const char short_options[] = "a:d:E:f:hl:m:p:s:";
+static const struct option long_options[] = {
+	{ "dll-calls", required_argument, NULL, 'd' },
+	{ "encoding",  required_argument, NULL, 'E' },
+	{ "functions", required_argument, NULL, 'f' },
+	{ "help",      no_argument,       NULL, 'h' },
+	{ "labels",    required_argument, NULL, 'l' },
+	{ "messages",  required_argument, NULL, 'm' },
+	{ "pages",     required_argument, NULL, 'p' },
+	{ "params",    required_argument, NULL, 'a' },
+	{ "seed",      required_argument, NULL, 's' },
+	{ 0, 0, 0, 0 }
+};
+
+static void usage(void) {
+	puts("Usage: genproject [options] directory");
+	puts("Options:");
+	puts("    -d, --dll-calls <n>       Make <n>% of the statements DLL calls (default: 5)");
+	puts("    -Es, --encoding=sjis      Write sources in SJIS");
+	puts("    -Eu, --encoding=utf8      Write sources in UTF-8 (default)");
+	puts("    -f, --functions <n>       Define <n> functions (default: 100)");
+	puts("    -h, --help                Display this message and exit");
+	puts("    -l, --labels <n>          Put <n> labels in each page (default: 100)");
+	puts("    -m, --messages <n>        Make <n>% of the statements messages (default: 40)");
+	puts("    -p, --pages <n>           Generate <n> pages (default: 100)");
+	puts("    -a, --params <n>          Give each function <n> parameters (default: 2)");
+	puts("    -s, --seed <n>            Seed of the random number generator (default: 1)");
+}
+
+static struct {
+	int pages;
+	int labels;
+	int functions;
+	int params;
+	int messages;
+	int dll_calls;
+	bool sjis;
+} opts = { 100, 100, 100, 2, 40, 5, false };
+
+// xorshift32, so that the output does not depend on the C library.
+static uint32_t rng_state;
+
+static uint32_t rnd(uint32_t n) {
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state % n;
+}
+
+// Writes a line of source, converting it to SJIS if needed.
+static void put_line(FILE *fp, const char *fmt, ...) {
+	char buf[256];
+	va_list args;
+	va_start(args, fmt);
+	vsnprintf(buf, sizeof(buf), fmt, args);
+	va_end(args);
+	fputs(opts.sjis ? utf2sjis(buf) : buf, fp);
+	fputc('\n', fp);
+}
+
+static const char *messages[] = {
+	"「おはようございます。今日もいい天気ですね」",
+	"窓の外から、鳥の鳴き声が聞こえてくる。",
+	"……この部屋に来るのは、%d回目だ。",
+	"「それじゃあ、また明日」",
+	"彼女は小さく頷いて、ページ%dの扉を開けた。",
+};
+#define NR_MESSAGES (int)(sizeof(messages) / sizeof(messages[0]))
+
+static void statement(FILE *fp, int page) {
+	int r = rnd(100);
+	if (r < opts.messages) {
+		char text[128];
+		snprintf(text, sizeof(text), messages[rnd(NR_MESSAGES)], page);
+		put_line(fp, "\t'%s'", text);
+		if (!rnd(4))
+			put_line(fp, "\tA");
+		return;
+	}
+	r -= opts.messages;
+	if (r < opts.dll_calls) {
+		put_line(fp, "\t" DLL_NAME ".Func%d V%d, %d:", rnd(NR_DLL_FUNCS), rnd(NR_VARIABLES), rnd(1000));
+		return;
+	}
+	switch (rnd(opts.functions > 0 ? 3 : 2)) {
+	case 0:
+		put_line(fp, "\t!V%d:V%d+%d*V%d!", rnd(NR_VARIABLES), rnd(NR_VARIABLES), rnd(100), rnd(NR_VARIABLES));
+		break;
+	case 1:
+		put_line(fp, "\t{V%d<%d: @L%d:}", rnd(NR_VARIABLES), rnd(1000), rnd(opts.labels));
+		break;
+	case 2:
+		{
+			char args[128] = "";
+			char *p = args;
+			for (int i = 0; i < opts.params && p < args + sizeof(args) - 16; i++)
+				p += sprintf(p, "%sV%d+%d", i ? ", " : " ", rnd(NR_VARIABLES), i);
+			put_line(fp, "\t~F%d%s:", rnd(opts.functions), args);
+		}
+		break;
+	}
+}
+
+static void write_page(const char *dir, int page) {
+	char name[32];
+	sprintf(name, "p%d.adv", page);
+	FILE *fp = checked_fopen(path_join(dir, name), "w");
+
+	if (page == 0) {
+		for (int i = 0; i < NR_VARIABLES; i++)
+			put_line(fp, "\t!V%d:0!", i);
+		for (int i = 0; i < opts.params; i++)
+			put_line(fp, "\t!P%d:0!", i);
+	}
+	for (int l = 0; l < opts.labels; l++) {
+		put_line(fp, "*L%d:", l);
+		for (int i = 0; i < BLOCK_STATEMENTS; i++)
+			statement(fp, page);
+	}
+	put_line(fp, "\t@L0:");
+
+	// Function i is defined in page (i % pages).
+	for (int f = page; f < opts.functions; f += opts.pages) {
+		char params[128] = "";
+		char *p = params;
+		for (int i = 0; i < opts.params && p < params + sizeof(params) - 8; i++)
+			p += sprintf(p, "%sP%d", i ? "," : " ", i);
+		put_line(fp, "**F%d%s:", f, params);
+		for (int i = 0; i < BLOCK_STATEMENTS / 2; i++)
+			statement(fp, page);
+		put_line(fp, "\t~0, V%d:", rnd(NR_VARIABLES));
+	}
+	fclose(fp);
+}
+
+static int parse_count(const char *s, int max) {
+	char *end;
+	long n = strtol(s, &end, 10);
+	if (*end || n < 0 || n > max)
+		error("genproject: invalid number: %s", s);
+	return n;
+}
+
+int main(int argc, char *argv[]) {
+	init(&argc, &argv);
+
+	uint32_t seed = 1;
+	int opt;
+	while ((opt = getopt_long(argc, argv, short_options, long_options, NULL)) != -1) {
+		switch (opt) {
+		case 'a':
+			opts.params = parse_count(optarg, 8);
+			break;
+		case 'd':
+			opts.dll_calls = parse_count(optarg, 100);
+			break;
+		case 'E':
+			switch (optarg[0]) {
+			case 's': case 'S': opts.sjis = true; break;
+			case 'u': case 'U': opts.sjis = false; break;
+			default: error("Unknown encoding %s", optarg);
+			}
+			break;
+		case 'f':
+			opts.functions = parse_count(optarg, 1000000);
+			break;
+		case 'h':
+			usage();
+			return 0;
+		case 'l':
+			opts.labels = parse_count(optarg, 1000000);
+			break;
+		case 'm':
+			opts.messages = parse_count(optarg, 100);
+			break;
+		case 'p':
+			opts.pages = parse_count(optarg, 65535);
+			break;
+		case 's':
+			seed = parse_count(optarg, INT32_MAX);
+			break;
+		case '?':
+			usage();
+			return 1;
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if (argc != 1) {
+		usage();
+		return 1;
+	}
+	if (opts.pages < 1 || opts.labels < 1)
+		error("genproject: a project needs at least one page and one label");
+	if (opts.messages + opts.dll_calls > 100)
+		error("genproject: messages and DLL calls exceed 100%%");
+
+	const char *dir = argv[0];
+	make_dir(dir);
+	rng_state = seed ? seed : 1;
+
+	FILE *fp = checked_fopen(path_join(dir, "xsys35c.cfg"), "w");
+	fputs("sys_ver = 3.9\n", fp);
+	if (opts.sjis)
+		fputs("encoding = sjis\n", fp);
+	fputs("hed = bench.hed\n", fp);
+	fclose(fp);
+
+	fp = checked_fopen(path_join(dir, "bench.hed"), "w");
+	fputs("#SYSTEM35\n", fp);
+	for (int i = 0; i < opts.pages; i++)
+		fprintf(fp, "p%d.adv\n", i);
+	fputs("\n#DLLHeader\n" DLL_NAME ".hel\n", fp);
+	fclose(fp);
+
+	fp = checked_fopen(path_join(dir, DLL_NAME ".hel"), "w");
+	for (int i = 0; i < NR_DLL_FUNCS; i++)
+		fprintf(fp, "void Func%d(int var, int n)\n", i);
+	fclose(fp);
+
+	for (int i = 0; i < opts.pages; i++)
+		write_page(dir, i);
+	return 0;
+}